@@ -0,0 +1,95 @@
+/**
+ * @file shm_copy_benchmark.c
+ * @brief Compares writing to shared memory with `memcpy` and with the streaming copy, to tune the threshold.
+ *
+ * Usage: nxai-shm-copy-benchmark [working_set_bytes]
+ *
+ * Every iteration writes a frame to a segment and then sums a working set of the writer, like a writer
+ * that keeps processing its own data. The time of an iteration covers both. Streaming copies leave that working set in the cache, `memcpy`
+ * pulls the frame in instead. The threshold that suits the CPU is around the first size where the
+ * streaming copy wins.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nxai_shm_utils.h"
+
+static double _now_seconds( void ) {
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Writes frames to an attached segment and touches the working set after every write.
+ *
+ * @return Seconds per iteration.
+ */
+static double _run_copy( void *shm_buffer, const char *frame, size_t frame_size, const uint64_t *working_set, size_t working_set_words, size_t num_iterations ) {
+    volatile uint64_t sum = 0;
+    double start = _now_seconds();
+    for ( size_t iteration = 0; iteration < num_iterations; iteration++ ) {
+        nxai_shm_write_to_attached( shm_buffer, frame, frame_size );
+        uint64_t partial = 0;
+        for ( size_t index = 0; index < working_set_words; index++ ) {
+            partial += working_set[index];
+        }
+        sum += partial;
+    }
+    return ( _now_seconds() - start ) / (double) num_iterations;
+}
+
+int main( int argc, char **argv ) {
+    size_t working_set_size = argc > 1 ? strtoull( argv[1], NULL, 10 ) : 1024 * 1024;
+    if ( working_set_size < sizeof( uint64_t ) ) {
+        printf( "Usage: %s [working_set_bytes]\n", argv[0] );
+        return 1;
+    }
+    const size_t frame_sizes[] = { 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024, 64 * 1024 * 1024 };
+    const size_t max_frame_size = frame_sizes[sizeof( frame_sizes ) / sizeof( frame_sizes[0] ) - 1];
+
+    int shm_id;
+    nxai_shm_create_random( max_frame_size, &shm_id );
+    if ( shm_id == -1 ) {
+        return 1;
+    }
+    void *shm_buffer = nxai_shm_attach( shm_id );
+    char *frame = malloc( max_frame_size );
+    size_t working_set_words = working_set_size / sizeof( uint64_t );
+    uint64_t *working_set = malloc( working_set_words * sizeof( uint64_t ) );
+    if ( shm_buffer == (void *) -1 || frame == NULL || working_set == NULL ) {
+        printf( "Error: Could not set up the benchmark.\n" );
+        nxai_shm_destroy( shm_id );
+        return 1;
+    }
+    memset( frame, 1, max_frame_size );
+    memset( working_set, 2, working_set_words * sizeof( uint64_t ) );
+
+    printf( "Working set of %zu bytes\n", working_set_size );
+    printf( "%10s %14s %14s %8s\n", "bytes", "memcpy us", "stream us", "speedup" );
+    for ( size_t index = 0; index < sizeof( frame_sizes ) / sizeof( frame_sizes[0] ); index++ ) {
+        size_t frame_size = frame_sizes[index];
+        // About 1 GB per run, at least a few frames
+        size_t num_iterations = ( 1024UL * 1024 * 1024 ) / frame_size + 4;
+
+        nxai_shm_set_streaming_copy_threshold( SIZE_MAX );
+        _run_copy( shm_buffer, frame, frame_size, working_set, working_set_words, 4 );
+        double memcpy_seconds = _run_copy( shm_buffer, frame, frame_size, working_set, working_set_words, num_iterations );
+
+        nxai_shm_set_streaming_copy_threshold( 0 );
+        _run_copy( shm_buffer, frame, frame_size, working_set, working_set_words, 4 );
+        double stream_seconds = _run_copy( shm_buffer, frame, frame_size, working_set, working_set_words, num_iterations );
+
+        printf( "%10zu %14.1f %14.1f %7.2fx\n", frame_size, memcpy_seconds * 1e6, stream_seconds * 1e6, memcpy_seconds / stream_seconds );
+    }
+
+    nxai_shm_close( shm_buffer );
+    nxai_shm_destroy( shm_id );
+    free( frame );
+    free( working_set );
+    return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file shm_ring_benchmark.c
+ * @brief Compares passing messages to another process through a socket and through a shared memory ring.
+ *
+ * Usage: nxai-shm-ring-benchmark [num_messages] [ring_capacity]
+ *
+ * A child process receives every message, the parent sends them back to back. The time runs from the
+ * first send until the child has received the last message, for a range of message sizes.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nxai_shm_utils.h"
+#include "nxai_socket_utils.h"
+
+static double _now_seconds( void ) {
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Sends messages over a socket pair to a child process.
+ *
+ * @return Seconds until the child received all messages, or 0 if the run failed.
+ */
+static double _run_socket( size_t message_size, size_t num_messages ) {
+    int socket_fds[2];
+    if ( socketpair( AF_UNIX, SOCK_STREAM, 0, socket_fds ) == -1 ) {
+        return 0;
+    }
+    pid_t receiver_pid = fork();
+    if ( receiver_pid == 0 ) {
+        close( socket_fds[0] );
+        char *message = NULL;
+        size_t allocated = 0;
+        uint32_t message_length = 0;
+        for ( size_t index = 0; index < num_messages; index++ ) {
+            if ( nxai_socket_receive_on_connection( socket_fds[1], &allocated, &message, &message_length ) == false ) {
+                _exit( 1 );
+            }
+        }
+        _exit( 0 );
+    }
+    close( socket_fds[1] );
+    char *message = calloc( 1, message_size );
+    double start = _now_seconds();
+    bool sent = receiver_pid != -1 && message != NULL;
+    for ( size_t index = 0; sent && index < num_messages; index++ ) {
+        sent = nxai_socket_send_to_connection( socket_fds[0], message, (uint32_t) message_size );
+    }
+    int status = 1;
+    if ( receiver_pid != -1 ) {
+        waitpid( receiver_pid, &status, 0 );
+    }
+    double elapsed = _now_seconds() - start;
+    close( socket_fds[0] );
+    free( message );
+    return sent && WIFEXITED( status ) && WEXITSTATUS( status ) == 0 ? elapsed : 0;
+}
+
+/**
+ * @brief Sends messages through a shared memory ring to a child process.
+ *
+ * @return Seconds until the child received all messages, or 0 if the run failed.
+ */
+static double _run_ring( size_t message_size, size_t num_messages, size_t ring_capacity ) {
+    nxai_shm_ring_t *ring = nxai_shm_ring_create( IPC_PRIVATE, ring_capacity );
+    if ( ring == NULL ) {
+        return 0;
+    }
+    // The child inherits the attached ring
+    pid_t receiver_pid = fork();
+    if ( receiver_pid == 0 ) {
+        char *message = NULL;
+        size_t allocated = 0;
+        uint32_t message_length = 0;
+        for ( size_t index = 0; index < num_messages; index++ ) {
+            if ( nxai_shm_ring_receive( ring, &allocated, &message, &message_length ) == false ) {
+                _exit( 1 );
+            }
+        }
+        _exit( 0 );
+    }
+    char *message = calloc( 1, message_size );
+    double start = _now_seconds();
+    bool sent = receiver_pid != -1 && message != NULL;
+    for ( size_t index = 0; sent && index < num_messages; index++ ) {
+        sent = nxai_shm_ring_send( ring, message, (uint32_t) message_size );
+    }
+    int status = 1;
+    if ( receiver_pid != -1 ) {
+        waitpid( receiver_pid, &status, 0 );
+    }
+    double elapsed = _now_seconds() - start;
+    nxai_shm_ring_destroy( ring );
+    free( message );
+    return sent && WIFEXITED( status ) && WEXITSTATUS( status ) == 0 ? elapsed : 0;
+}
+
+int main( int argc, char **argv ) {
+    size_t num_messages = argc > 1 ? strtoull( argv[1], NULL, 10 ) : 100000;
+    size_t ring_capacity = argc > 2 ? strtoull( argv[2], NULL, 10 ) : 4 * 1024 * 1024;
+    if ( num_messages == 0 || ring_capacity == 0 ) {
+        printf( "Usage: %s [num_messages] [ring_capacity]\n", argv[0] );
+        return 1;
+    }
+    const size_t message_sizes[] = { 64, 1024, 16 * 1024, 256 * 1024 };
+
+    printf( "%zu messages per size, ring of %zu bytes\n", num_messages, ring_capacity );
+    printf( "%10s %16s %16s %8s\n", "bytes", "socket msg/s", "ring msg/s", "speedup" );
+    for ( size_t index = 0; index < sizeof( message_sizes ) / sizeof( message_sizes[0] ); index++ ) {
+        size_t message_size = message_sizes[index];
+        // Large messages take long enough with fewer of them
+        size_t num_sized = message_size > 16 * 1024 ? num_messages / 10 + 1 : num_messages;
+        double socket_seconds = _run_socket( message_size, num_sized );
+        double ring_seconds = _run_ring( message_size, num_sized, ring_capacity );
+        if ( socket_seconds == 0 || ring_seconds == 0 ) {
+            printf( "Error: Benchmark run with %zu byte messages failed.\n", message_size );
+            return 1;
+        }
+        printf( "%10zu %16.0f %16.0f %7.2fx\n", message_size, (double) num_sized / socket_seconds, (double) num_sized / ring_seconds, socket_seconds / ring_seconds );
+    }
+    return 0;
+}
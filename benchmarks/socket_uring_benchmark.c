@@ -0,0 +1,126 @@
+/**
+ * @file socket_uring_benchmark.c
+ * @brief Compares the round trip throughput of the epoll and the io_uring listener.
+ *
+ * Usage: nxai-socket-uring-benchmark [message_size] [messages_per_client] [num_clients]
+ *
+ * Every client thread keeps one connection and sends a message, waiting for the echoed reply before
+ * sending the next one. Each listener runs in its own process, since interrupting listeners is process wide.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nxai_socket_utils.h"
+
+#define BENCHMARK_SOCKET_PATH "/tmp/nxai-socket-uring-benchmark.sock"
+
+typedef struct {
+    size_t message_size;
+    size_t num_messages;
+    bool failed;
+} _client_arguments_t;
+
+static double _now_seconds( void ) {
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+static void _echo( const char *message, uint32_t message_length, int connection_fd ) {
+    nxai_socket_send_to_connection( connection_fd, message, message_length );
+}
+
+static void *_client_run( void *arguments_pointer ) {
+    _client_arguments_t *arguments = arguments_pointer;
+    int connection_fd = nxai_socket_connect( BENCHMARK_SOCKET_PATH );
+    char *message = calloc( 1, arguments->message_size );
+    char *reply = NULL;
+    size_t reply_allocated = 0;
+    arguments->failed = connection_fd == -1 || message == NULL;
+    for ( size_t index = 0; arguments->failed == false && index < arguments->num_messages; index++ ) {
+        uint32_t reply_length = nxai_socket_send_receive_on_connection( connection_fd, message, (uint32_t) arguments->message_size, &reply, &reply_allocated );
+        arguments->failed = reply_length != arguments->message_size;
+    }
+    if ( connection_fd != -1 ) {
+        close( connection_fd );
+    }
+    free( message );
+    free( reply );
+    return NULL;
+}
+
+/**
+ * @brief Starts a listener in a child process and measures the round trips of all clients against it.
+ *
+ * @return Round trips per second, or 0 if the run failed.
+ */
+static double _run( bool use_uring, size_t message_size, size_t num_messages, size_t num_clients ) {
+    unlink( BENCHMARK_SOCKET_PATH );
+    pid_t listener_pid = fork();
+    if ( listener_pid == 0 ) {
+        if ( use_uring ) {
+            nxai_socket_start_uring_listener( BENCHMARK_SOCKET_PATH, _echo );
+        } else {
+            nxai_socket_start_listener( BENCHMARK_SOCKET_PATH, _echo );
+        }
+        _exit( 0 );
+    }
+    if ( listener_pid == -1 ) {
+        return 0;
+    }
+    // Wait for the socket to appear
+    for ( int attempt = 0; attempt < 100 && access( BENCHMARK_SOCKET_PATH, F_OK ) != 0; attempt++ ) {
+        usleep( 10000 );
+    }
+
+    pthread_t *threads = calloc( num_clients, sizeof( pthread_t ) );
+    _client_arguments_t *arguments = calloc( num_clients, sizeof( _client_arguments_t ) );
+    double start = _now_seconds();
+    for ( size_t index = 0; index < num_clients; index++ ) {
+        arguments[index].message_size = message_size;
+        arguments[index].num_messages = num_messages;
+        pthread_create( &threads[index], NULL, _client_run, &arguments[index] );
+    }
+    bool failed = false;
+    for ( size_t index = 0; index < num_clients; index++ ) {
+        pthread_join( threads[index], NULL );
+        failed = failed || arguments[index].failed;
+    }
+    double elapsed = _now_seconds() - start;
+    free( threads );
+    free( arguments );
+
+    kill( listener_pid, SIGKILL );
+    waitpid( listener_pid, NULL, 0 );
+    unlink( BENCHMARK_SOCKET_PATH );
+    return failed ? 0 : (double) ( num_messages * num_clients ) / elapsed;
+}
+
+int main( int argc, char **argv ) {
+    size_t message_size = argc > 1 ? strtoull( argv[1], NULL, 10 ) : 256;
+    size_t num_messages = argc > 2 ? strtoull( argv[2], NULL, 10 ) : 20000;
+    size_t num_clients = argc > 3 ? strtoull( argv[3], NULL, 10 ) : 8;
+    if ( message_size == 0 || message_size > UINT32_MAX || num_messages == 0 || num_clients == 0 ) {
+        printf( "Usage: %s [message_size] [messages_per_client] [num_clients]\n", argv[0] );
+        return 1;
+    }
+
+    printf( "%zu clients, %zu round trips of %zu bytes each\n", num_clients, num_messages, message_size );
+    double epoll_rate = _run( false, message_size, num_messages, num_clients );
+    double uring_rate = _run( true, message_size, num_messages, num_clients );
+    if ( epoll_rate == 0 || uring_rate == 0 ) {
+        printf( "Error: Benchmark run failed.\n" );
+        return 1;
+    }
+    printf( "epoll:    %12.0f round trips/s\n", epoll_rate );
+    printf( "io_uring: %12.0f round trips/s (%.2fx)\n", uring_rate, uring_rate / epoll_rate );
+    return 0;
+}
@@ -17,6 +17,28 @@ mpack_tree_t *copy_mpack_node( mpack_node_t input_node );
 
 void copy_mpack_object_recursive( mpack_node_t node, mpack_writer_t *writer );
 
+/**
+ * @brief Initialises a writer that writes msgpack directly into a shared memory segment.
+ *
+ * Uses `nxai_shm_reserve`, so the data is never copied. When the data does not fit, the writer fails
+ * with `mpack_error_too_big`. Always finish with `nxai_shm_mpack_writer_commit`.
+ *
+ * @param writer The writer to initialise.
+ * @param shm_id The ID of the shared memory segment.
+ *
+ * @return false if the segment could not be attached, the writer is then not initialised.
+ */
+bool nxai_shm_mpack_writer_init( mpack_writer_t *writer, int shm_id );
+
+/**
+ * @brief Destroys a writer from `nxai_shm_mpack_writer_init`, and commits what it wrote.
+ *
+ * @param writer The writer.
+ *
+ * @return false if the writer failed, for example because the data did not fit. Nothing is committed then.
+ */
+bool nxai_shm_mpack_writer_commit( mpack_writer_t *writer );
+
 #ifdef __cplusplus
 }
 #endif
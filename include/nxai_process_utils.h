@@ -19,6 +19,9 @@ uint64_t nxai_current_timestamp_ms();
 
 uint64_t nxai_current_timestamp_us();
 
+// Microseconds on a clock that only moves forward, for deadlines and durations
+uint64_t nxai_monotonic_timestamp_us();
+
 void nxai_initialise_logging( const char *start_log_filepath, const char *rotating_log_filepath, const char *log_prefix, bool log_to_console );
 
 void nxai_finalise_logging();
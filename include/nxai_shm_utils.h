@@ -9,6 +9,30 @@ extern "C" {
 #include <sys/shm.h>
 #include <sys/types.h>
 
+/**
+ * @brief Size of the header at the start of every shared memory segment, the payload follows it.
+ *
+ * The header holds, in native byte order: the 32-bit sentinel 0xFFFFFFFF, the 32-bit magic "NXS2",
+ * the 64-bit payload size, the 32-bit payload offset, which is 64, 16-bit flags, a 16-bit flag that is
+ * set once the segment was replaced, the 32-bit generation, the 32-bit identifier of the segment that
+ * replaced it, the 64-bit seqlock sequence, which is odd while a write is in progress, the 64-bit
+ * capacity, a 64-bit timestamp in microseconds since the epoch and a 64-bit checksum. The payload is
+ * thus aligned for vector instructions. Every writer uses this header, so every reader can read every
+ * segment. Segments written by older versions start with the 32-bit payload size, followed by the
+ * payload at offset 4, and are still read.
+ */
+#define NXAI_SHM_HEADER_BYTES 64
+
+/**
+ * @brief Message ring buffer in shared memory, see `nxai_shm_ring_create`.
+ */
+typedef struct nxai_shm_ring nxai_shm_ring_t;
+
+/**
+ * @brief Pool of fixed size frame slots in shared memory, see `nxai_shm_frame_pool_create`.
+ */
+typedef struct nxai_shm_frame_pool nxai_shm_frame_pool_t;
+
 bool nxai_create_pipe( int pipefd[2] );
 
 /**
@@ -44,8 +68,36 @@ char nxai_pipe_timed_read( int fd, int timeout );
  */
 void nxai_pipe_close( int semaphore );
 
+/**
+ * @brief Creates a shared memory segment under a new key.
+ *
+ * Keys are made from the process id and a counter, so creation does not search for a free key and
+ * processes do not compete for keys. A process with more than 1024 segments searches for free keys for
+ * the others. A segment made with `nxai_shm_preallocate` is used when one fits,
+ * `nxai_shm_get_size` then returns its full size.
+ *
+ * @param size The size of the data the segment holds.
+ * @param shm_id Set to the identifier of the segment, -1 if it could not be created.
+ * @return The key of the segment, -1 with `shm_id` set to -1 and errno set if the segment could not be created.
+ */
 key_t nxai_shm_create_random( size_t size, int *shm_id );
 
+/**
+ * @brief Creates shared memory segments ahead of time for `nxai_shm_create_random`.
+ *
+ * Call this at startup, so creating segments later does not wait for the kernel.
+ *
+ * @param count The number of segments to create.
+ * @param size The size of the data each segment holds.
+ * @return false if not all segments could be created, the ones that were created are destroyed again.
+ */
+bool nxai_shm_preallocate( size_t count, size_t size );
+
+/**
+ * @brief Destroys the segments made with `nxai_shm_preallocate` that were not handed out.
+ */
+void nxai_shm_destroy_preallocated( void );
+
 /**
  * @brief Sends a single character through a pipe.
  *
@@ -70,7 +122,30 @@ int nxai_shm_get( key_t shm_key );
 
 void *nxai_shm_attach( int shm_id );
 
-void nxai_shm_write_to_attached( void *shm_buffer, const char *data, uint32_t size );
+/**
+ * @brief Writes data to an attached shared memory segment, after a header with its size.
+ *
+ * Data of at least the streaming copy threshold is copied past the cache of the writer, see
+ * `nxai_shm_set_streaming_copy_threshold`.
+ *
+ * @param shm_buffer The attached segment, at least `NXAI_SHM_HEADER_BYTES + size` bytes. Nothing is
+ *                   written if the header of an earlier write says the data does not fit.
+ * @param data The data to be written to the shared memory segment.
+ * @param size The size of the data.
+ */
+void nxai_shm_write_to_attached( void *shm_buffer, const char *data, size_t size );
+
+/**
+ * @brief Sets the size from which data is written to shared memory with non-temporal stores.
+ *
+ * Such stores do not keep the data in the cache of the writer, which only the reader needs. This is faster
+ * for data larger than a good part of the cache, and slower for data that fits in it. The default is 4 MB,
+ * tune it for the CPU, `benchmarks/shm_copy_benchmark.c` shows where both copies cross. Pass SIZE_MAX to
+ * always use `memcpy`. Only x86-64 and aarch64 have a streaming copy.
+ *
+ * @param threshold The size in bytes, at least 256.
+ */
+void nxai_shm_set_streaming_copy_threshold( size_t threshold );
 
 /**
  * @brief Creates a shared memory segment.
@@ -88,29 +163,127 @@ void nxai_shm_write_to_attached( void *shm_buffer, const char *data, uint32_t si
  */
 key_t nxai_shm_create( char *path, int project_id, size_t size, int *shm_id );
 
+/**
+ * @brief Flag for `nxai_shm_create_with_flags` and `nxai_shm_fd_create` to back the segment with huge pages.
+ *
+ * Falls back to transparent huge pages, and to normal pages, when no huge pages are reserved on the system.
+ * Descriptor backed segments only fall back to normal pages, see `NXAI_SHM_FD_HUGE_PAGES`.
+ * A 24 MB frame then takes 12 page faults instead of about 6000.
+ */
+#define NXAI_SHM_HUGE_PAGES 0x1
+
+/**
+ * @brief Flag for `nxai_shm_create_with_flags` and `nxai_shm_fd_create` to allocate all pages on creation.
+ *
+ * The first write to the segment then does not wait for pages to be allocated.
+ */
+#define NXAI_SHM_PREFAULT 0x2
+
+/**
+ * @brief Creates a shared memory segment like `nxai_shm_create`, with control over its pages.
+ *
+ * Every option falls back to the behaviour of `nxai_shm_create` with a warning when it is not available.
+ *
+ * @param path The pathname to be used in generating the key, or NULL to use a new key like `nxai_shm_create_random`.
+ * @param project_id The project identifier to be used in generating the key.
+ * @param size The size of the data the segment holds.
+ * @param flags 0 or a combination of `NXAI_SHM_HUGE_PAGES` and `NXAI_SHM_PREFAULT`.
+ * @param numa_node The NUMA node to prefer for the pages, for example the node of the device that reads them,
+ *                  or -1 for any node.
+ * @param shm_id Set to the identifier of the segment, -1 if it could not be created.
+ *
+ * @return The key used to create the shared memory segment.
+ */
+key_t nxai_shm_create_with_flags( char *path, int project_id, size_t size, unsigned int flags, int numa_node, int *shm_id );
+
+/**
+ * @brief Maps all pages of an attached segment into this process up front.
+ *
+ * Each process that attaches a segment takes its own page faults on first access, this takes them at once.
+ *
+ * @param shm_pointer The attached segment.
+ * @param size The size of the mapping, the size of the data plus `NXAI_SHM_HEADER_BYTES`.
+ */
+void nxai_shm_prefault( void *shm_pointer, size_t size );
+
 /**
  * @brief Writes data to a shared memory segment.
  *
- * This function attaches a shared memory segment to the process's address space, writes the size of the data and the data itself to the shared memory segment, and then detaches the shared memory segment from the process's address space.
+ * This function writes the size of the data and the data itself to the shared memory segment.
+ * The segment stays attached to the process's address space after the first write, so repeated writes
+ * to the same segment only copy the data. See `nxai_shm_cache_evict`.
  *
  * @param shm_id The ID of the shared memory segment.
  * @param data The data to be written to the shared memory segment.
  * @param size The size of the data to be written to the shared memory segment.
  *
- * @note This function does not check if the shared memory segment is large enough to hold the data. It is the responsibility of the caller to ensure this.
+ * Segments created by older versions, with room for the size and the data only, are written in the
+ * old format when the data does not fit otherwise.
+ *
+ * @return true if the data was written, false if the segment could not be attached or is too small.
+ */
+bool nxai_shm_write( int shm_id, const char *data, size_t size );
+
+/**
+ * @brief Gets the memory the data of a segment goes in, to build the data there instead of copying it.
+ *
+ * The segment stays attached like with `nxai_shm_write`. Write at most `capacity` bytes, then call
+ * `nxai_shm_commit`, or `nxai_shm_cancel` to give up. See `nxai_shm_mpack_writer_init` to write msgpack.
+ *
+ * @param shm_id The ID of the shared memory segment.
+ * @param capacity Set to the size of the data the segment holds.
+ *
+ * @return The memory after the header, or NULL if the segment could not be attached.
+ */
+char *nxai_shm_reserve( int shm_id, size_t *capacity );
+
+/**
+ * @brief Sets the size of the data written to memory from `nxai_shm_reserve`, so readers find it.
+ *
+ * @param payload The memory returned by `nxai_shm_reserve`.
+ * @param size The size of the data.
+ *
+ * @return false if the memory was not reserved or the size is larger than the capacity. The memory is
+ *         released either way.
+ */
+bool nxai_shm_commit( char *payload, size_t size );
+
+/**
+ * @brief Releases memory from `nxai_shm_reserve` without committing data.
+ *
+ * The segment then holds the size of the previous data, but its contents may have been overwritten.
+ *
+ * @param payload The memory returned by `nxai_shm_reserve`.
  */
-bool nxai_shm_write( int shm_id, const char *data, uint32_t size );
+void nxai_shm_cancel( char *payload );
 
+/**
+ * @brief Writes the header for data of `size` bytes that is already in an attached segment.
+ *
+ * @param shm_buffer The attached segment, the data is at `NXAI_SHM_HEADER_BYTES` from its start.
+ * @param size The size of the data.
+ */
+void nxai_shm_commit_to_attached( void *shm_buffer, size_t size );
+
+/**
+ * @brief Finds the data in an attached shared memory segment, in the current or the old format.
+ *
+ * @param shm_pointer The attached segment.
+ * @param data_length Set to the size of the data.
+ * @param payload_data Set to the data after the header.
+ */
 void nxai_shm_read_from_attached( void *shm_pointer, size_t *data_length, char **payload_data );
 
 /**
  * @brief Reads data from shared memory.
  *
  * This function reads data from shared memory and returns a pointer to the shared memory block.
- * The first 4 bytes of the shared memory is always the size of the tensor.
- * The payload returned is a pointer to the shared memory block after the size header.
+ * The shared memory starts with a header holding the size of the tensor, see `NXAI_SHM_HEADER_BYTES`.
+ * The payload returned is a pointer to the shared memory block after the header.
  * This process attaches the shared memory block to this process and keeps it attached.
- * Call `nxai_shm_close` when this memory is no longer in use.
+ * Call `nxai_shm_close` when this memory is no longer in use. The segment then stays attached for
+ * later reads and writes, until it is destroyed or evicted with `nxai_shm_cache_evict`. Up to 64 segments
+ * stay attached, the least recently used one is detached to make room for another.
  *
  * @param shm_id The shared memory ID.
  * @param data_length A pointer to a size_t variable where the function will store the size of the tensor.
@@ -124,6 +297,7 @@ void *nxai_shm_read( int shm_id, size_t *data_length, char **payload_data );
  * @brief Detaches shared memory from the current process.
  *
  * This function detaches the shared memory from the current process.
+ * Memory returned by `nxai_shm_read` is only released, it stays attached for later use.
  *
  * @param memory_address A pointer to the shared memory.
  */
@@ -134,6 +308,7 @@ void nxai_shm_close( void *memory_address );
  *
  * This function destroys a shared memory segment identified by shm_id.
  * It uses the shmctl system call with the IPC_RMID command to remove the shared memory segment.
+ * The segment is also evicted from the attachment cache of this process.
  *
  * @param shm_id The identifier of the shared memory segment to be destroyed.
  *
@@ -143,12 +318,34 @@ void nxai_shm_close( void *memory_address );
  */
 int nxai_shm_destroy( int shm_id );
 
+/**
+ * @brief Detaches a segment that `nxai_shm_write` and `nxai_shm_read` keep attached.
+ *
+ * Segments destroyed or replaced by another process are detached when they are no longer referenced,
+ * call this to detach other segments. Memory returned by `nxai_shm_read` and not yet closed is detached
+ * when it is closed.
+ *
+ * @param shm_id The identifier of the shared memory segment.
+ */
+void nxai_shm_cache_evict( int shm_id );
+
+/**
+ * @brief Detaches all segments that `nxai_shm_write` and `nxai_shm_read` keep attached.
+ */
+void nxai_shm_cache_clear( void );
+
 /**
  * \brief Reallocates shared memory.
  *
  * This function first destroys the old shared memory identified by `old_shm_id`, then creates a new shared memory with the given `shm_key` and `new_size`.
+ * The contents of the old shared memory that fit are copied to the new shared memory, and its generation is advanced.
  * If the old shared memory cannot be destroyed, the function returns -1. Otherwise, it returns the identifier of the new shared memory.
  *
+ * Processes that have the old shared memory attached keep a valid mapping. The old shared memory points to the new one,
+ * `nxai_shm_read` and `nxai_shm_write` with the old identifier use the new shared memory from their next call on.
+ * In the calling process this holds for shared memory in the old format as well.
+ * Processes that attach it themselves can find it with `nxai_shm_get_next_id`. Writers should use the returned identifier.
+ *
  * \param shm_key The key of the shared memory to be reallocated.
  * \param old_shm_id The identifier of the old shared memory to be destroyed.
  * \param new_size The size of the new shared memory to be created.
@@ -157,17 +354,447 @@ int nxai_shm_destroy( int shm_id );
  */
 int nxai_shm_realloc( key_t shm_key, int old_shm_id, size_t new_size );
 
+/**
+ * @brief Gets the shared memory that replaced an attached shared memory segment in `nxai_shm_realloc`.
+ *
+ * @param shm_pointer The attached segment.
+ * @return The identifier of the new segment, -1 if the segment was not replaced.
+ */
+int nxai_shm_get_next_id( const void *shm_pointer );
+
+/**
+ * @brief Gets how often the data in an attached segment moved to a larger segment with `nxai_shm_realloc`.
+ *
+ * @param shm_pointer The attached segment.
+ * @return The generation, 0 for a segment that was never reallocated.
+ */
+uint64_t nxai_shm_get_generation( const void *shm_pointer );
+
 /**
  * @brief Get the size of shared memory segment
  *
  * This function retrieves the size of a shared memory segment identified by shm_id.
- * It subtracts HEADER_BYTES from the total size of the shared memory segment.
+ * It subtracts NXAI_SHM_HEADER_BYTES from the total size of the shared memory segment, so segments
+ * created by this library report the size they were created with. Segments without the current header
+ * were created by older versions, whose header is 4 bytes, so only 4 bytes are subtracted.
+ * `nxai_shm_write` writes data of that size in the old format.
  *
  * @param shm_id Identifier of the shared memory segment
- * @return Size of the shared memory segment minus HEADER_BYTES
+ * @return Size of the shared memory segment minus its header, 0 on failure
  */
 size_t nxai_shm_get_size( int shm_id );
 
+/**
+ * @brief Size of the header of segments written with `nxai_shm_seqlock_write`.
+ *
+ * Seqlock segments use the normal header, see `NXAI_SHM_HEADER_BYTES`, so `nxai_shm_read` reads them
+ * and `nxai_shm_seqlock_read` reads segments written with `nxai_shm_write`.
+ */
+#define NXAI_SHM_SEQLOCK_HEADER_BYTES NXAI_SHM_HEADER_BYTES
+
+/**
+ * @brief Flag for `nxai_shm_seqlock_write` to store a checksum of the data, which readers verify.
+ */
+#define NXAI_SHM_SEQLOCK_CHECKSUM 0x1
+
+/**
+ * @brief Prepares an attached segment for `nxai_shm_seqlock_write` and `nxai_shm_seqlock_read`.
+ *
+ * Segments with a seqlock header can be read by any number of readers while a writer replaces the data,
+ * without a handshake: readers copy the latest data and retry if it changed while copying. Call this
+ * once, before the segment is used.
+ *
+ * @param shm_buffer The attached segment.
+ * @param size The size of the segment as given to `nxai_shm_create` or returned by `nxai_shm_get_size`.
+ *             The seqlock header is the normal header, so data of up to `size` bytes fits.
+ *
+ * @return true if the segment was prepared, false if `size` is 0.
+ */
+bool nxai_shm_seqlock_init( void *shm_buffer, size_t size );
+
+/**
+ * @brief Replaces the data of a segment prepared with `nxai_shm_seqlock_init`.
+ *
+ * Only one process or thread may write to a segment at a time.
+ *
+ * @param shm_buffer The attached segment.
+ * @param data The data to write.
+ * @param size The size of the data.
+ * @param flags 0 or `NXAI_SHM_SEQLOCK_CHECKSUM`.
+ *
+ * @return true if the data was written, false if it does not fit.
+ */
+bool nxai_shm_seqlock_write( void *shm_buffer, const char *data, size_t size, unsigned int flags );
+
+/**
+ * @brief Returns the sequence of the data in a segment, which changes with every write.
+ *
+ * Compare it to the sequence of the last read to check for new data without copying it.
+ *
+ * @param shm_buffer The attached segment.
+ * @return The sequence, odd while a write is in progress.
+ */
+uint64_t nxai_shm_seqlock_get_sequence( const void *shm_buffer );
+
+/**
+ * @brief Copies a consistent snapshot of the data in a segment.
+ *
+ * Does not block the writer. A copy that was overwritten while it was made is retried.
+ *
+ * @param shm_buffer The attached segment.
+ * @param allocated_buffer_size A pointer to the size of the allocated buffer.
+ * @param data_buffer A pointer to the buffer for the data, reallocated if the data does not fit.
+ * @param data_length Set to the length of the data. Set to 0 on failure.
+ * @param sequence Set to the sequence of the data. Can be NULL.
+ * @param timestamp_us Set to the time the data was written. Can be NULL.
+ *
+ * @return true if a snapshot was copied, false if the checksum did not match or no consistent snapshot
+ *         could be made, for example because the writer stopped halfway. errno is EAGAIN in the latter case.
+ */
+bool nxai_shm_seqlock_read( const void *shm_buffer, size_t *allocated_buffer_size, char **data_buffer, size_t *data_length, uint64_t *sequence, uint64_t *timestamp_us );
+
+/**
+ * @brief Flag for `nxai_shm_fd_create` to back the segment with 2 MB huge pages, same as `NXAI_SHM_HUGE_PAGES`.
+ *
+ * The segment is a hugetlb memfd. It falls back to normal pages, not to transparent huge pages, when no
+ * huge pages are reserved on the system.
+ */
+#define NXAI_SHM_FD_HUGE_PAGES NXAI_SHM_HUGE_PAGES
+
+/**
+ * @brief Creates a shared memory segment that is referred to by a file descriptor.
+ *
+ * The segment is a memfd. Unlike SysV segments it is not limited by `shmmax`/`shmmni`, and it is freed
+ * automatically once every descriptor is closed and every mapping is gone, also when a process crashes.
+ * Other processes get access by receiving the descriptor, for example with
+ * `nxai_socket_send_with_fds_to_connection`. The segment has the same layout as SysV segments, a header
+ * followed by the data, so `nxai_shm_write_to_attached` and `nxai_shm_read_from_attached`
+ * work on it.
+ *
+ * @param size The size of the data the segment holds.
+ * @param flags 0 or a combination of `NXAI_SHM_FD_HUGE_PAGES` and `NXAI_SHM_PREFAULT`. `NXAI_SHM_PREFAULT`
+ *              allocates the pages with `fallocate` on creation. Mappings of the segment are not advised,
+ *              prefaulted or placed on a NUMA node.
+ *
+ * @return The file descriptor of the segment, or -1 if it could not be created. Close it when done.
+ */
+int nxai_shm_fd_create( size_t size, unsigned int flags );
+
+/**
+ * @brief Creates a named POSIX shared memory segment, for processes that can not receive descriptors.
+ *
+ * Works like `nxai_shm_fd_create`, but other processes open the segment by name with
+ * `nxai_shm_fd_open_named`. Named segments remain until `nxai_shm_fd_unlink_named` is called, which
+ * can be done as soon as every process opened it. Named segments can not be sealed.
+ *
+ * @param name The name of the segment, starting with a slash, for example "/nxai_tensor".
+ * @param size The size of the data the segment holds.
+ *
+ * @return The file descriptor of the segment, or -1 if it could not be created or already exists.
+ */
+int nxai_shm_fd_create_named( const char *name, size_t size );
+
+/**
+ * @brief Opens a named segment created with `nxai_shm_fd_create_named`.
+ *
+ * @param name The name of the segment.
+ *
+ * @return The file descriptor of the segment, or -1 if it does not exist.
+ */
+int nxai_shm_fd_open_named( const char *name );
+
+/**
+ * @brief Removes the name of a named segment. The memory is freed once it is no longer in use.
+ *
+ * @param name The name of the segment.
+ *
+ * @return The return value of the shm_unlink call.
+ */
+int nxai_shm_fd_unlink_named( const char *name );
+
+/**
+ * @brief Seals a segment created with `nxai_shm_fd_create`, so its size can no longer change.
+ *
+ * Receivers can then map the segment without risking a crash because the sender shrank it.
+ * With `seal_writes` the content can no longer change either, this fails while the segment is still
+ * attached writable in any process. Sealed segments are attached read-only.
+ *
+ * @param shm_fd The file descriptor of the segment.
+ * @param seal_writes Whether to also prevent writing to the segment.
+ *
+ * @return true if the segment was sealed.
+ */
+bool nxai_shm_fd_seal( int shm_fd, bool seal_writes );
+
+/**
+ * @brief Get the size of the data a descriptor backed segment can hold.
+ *
+ * Can be larger than the size it was created with, when it is backed by huge pages.
+ *
+ * @param shm_fd The file descriptor of the segment.
+ * @return The size of the segment minus the header, 0 on failure.
+ */
+size_t nxai_shm_fd_get_size( int shm_fd );
+
+/**
+ * @brief Maps a descriptor backed segment into this process, like `nxai_shm_attach`.
+ *
+ * The mapping remains valid after the descriptor is closed. Detach with `nxai_shm_fd_close`.
+ *
+ * @param shm_fd The file descriptor of the segment.
+ * @return A pointer to the segment, or (void *) -1 on failure.
+ */
+void *nxai_shm_fd_attach( int shm_fd );
+
+/**
+ * @brief Writes data to a descriptor backed segment, like `nxai_shm_write`.
+ *
+ * The segment stays mapped after the first write, so repeated writes to the same segment only copy
+ * the data. Up to 16 segments stay mapped, see `nxai_shm_fd_cache_evict`.
+ *
+ * @param shm_fd The file descriptor of the segment.
+ * @param data The data to be written to the segment.
+ * @param size The size of the data, the caller ensures it fits.
+ *
+ * @return true if the data was written.
+ */
+bool nxai_shm_fd_write( int shm_fd, const char *data, size_t size );
+
+/**
+ * @brief Unmaps a segment that `nxai_shm_fd_write` keeps mapped.
+ *
+ * A mapping keeps the memory of the segment allocated, call this before closing the last descriptor
+ * of a segment that is no longer needed. A write in progress unmaps it when it is done.
+ *
+ * @param shm_fd The file descriptor of the segment.
+ */
+void nxai_shm_fd_cache_evict( int shm_fd );
+
+/**
+ * @brief Reads data from a descriptor backed segment, like `nxai_shm_read`.
+ *
+ * The segment stays attached, call `nxai_shm_fd_close` when the data is no longer in use.
+ *
+ * @param shm_fd The file descriptor of the segment.
+ * @param data_length Set to the size of the data.
+ * @param payload_data Set to the data after the header.
+ *
+ * @return A pointer to the segment, or NULL on failure.
+ */
+void *nxai_shm_fd_read( int shm_fd, size_t *data_length, char **payload_data );
+
+/**
+ * @brief Detaches a descriptor backed segment from this process.
+ *
+ * @param memory_address A pointer returned by `nxai_shm_fd_attach` or `nxai_shm_fd_read`.
+ * @param size The size of the segment as returned by `nxai_shm_fd_get_size`.
+ */
+void nxai_shm_fd_close( void *memory_address, size_t size );
+
+/**
+ * @brief Creates a ring buffer for passing messages between processes through shared memory.
+ *
+ * The ring carries length prefixed messages like a socket connection, but a message is copied only
+ * into and out of shared memory instead of through the kernel. One process receives, any number of
+ * threads or processes can send. Producers claim space without locks and publish in order, waiting
+ * processes are woken with a futex in the shared memory.
+ *
+ * @param shm_key The key of the shared memory segment, other processes attach with the same key.
+ * @param capacity The number of bytes for messages, rounded up to a power of two. Every message takes
+ *                 its length plus 8 bytes, rounded up to 8 bytes.
+ *
+ * @return The ring buffer, or NULL if it could not be created. Release with `nxai_shm_ring_close`
+ *         or `nxai_shm_ring_destroy`.
+ */
+nxai_shm_ring_t *nxai_shm_ring_create( key_t shm_key, size_t capacity );
+
+/**
+ * @brief Attaches to a ring buffer created by another process with `nxai_shm_ring_create`.
+ *
+ * @param shm_key The key the ring buffer was created with.
+ *
+ * @return The ring buffer, or NULL if it does not exist or is not initialised.
+ */
+nxai_shm_ring_t *nxai_shm_ring_attach( key_t shm_key );
+
+/**
+ * @brief Sets how long sending waits for space and receiving waits for a message. Defaults to 1 second.
+ *
+ * @param ring The ring buffer.
+ * @param timeout_ms The timeout in milliseconds.
+ */
+void nxai_shm_ring_set_timeout( nxai_shm_ring_t *ring, uint32_t timeout_ms );
+
+/**
+ * @brief Returns the id of the shared memory segment holding the ring buffer.
+ *
+ * @param ring The ring buffer.
+ * @return The shared memory id.
+ */
+int nxai_shm_ring_get_id( nxai_shm_ring_t *ring );
+
+/**
+ * @brief Sends a message through a ring buffer, like `nxai_socket_send_to_connection`.
+ *
+ * Waits for the consumer to free space when the ring is full, up to the timeout. Messages are published
+ * in the order their space was claimed, so a send also waits for concurrent sends that claimed space
+ * earlier, up to the same timeout. When that passes, the message is not sent: it is marked for the
+ * receiver to skip and left for the earlier sender to publish, so a sender that stalls or dies does
+ * not block the other senders forever. Messages behind a dead sender are never received, the ring
+ * has to be recreated.
+ *
+ * @param ring The ring buffer.
+ * @param message The message to send.
+ * @param message_length The length of the message.
+ *
+ * @return true if the message was sent, false if it does not fit in the ring or the timeout passed.
+ */
+bool nxai_shm_ring_send( nxai_shm_ring_t *ring, const char *message, uint32_t message_length );
+
+/**
+ * @brief Receives a message from a ring buffer, like `nxai_socket_receive_on_connection`.
+ *
+ * Only one thread may receive from a ring buffer. Waits for a message up to the timeout.
+ *
+ * @param ring The ring buffer.
+ * @param allocated_buffer_size A pointer to the size of the allocated buffer.
+ * @param message_input_buffer A pointer to the input buffer, reallocated if the message does not fit.
+ * @param message_length A pointer to a variable in which to store the length of the received message. Set to 0 on failure.
+ *
+ * @return true if a message was received, false if the timeout passed.
+ */
+bool nxai_shm_ring_receive( nxai_shm_ring_t *ring, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length );
+
+/**
+ * @brief Detaches a ring buffer from this process. The shared memory remains for other processes.
+ *
+ * @param ring The ring buffer, freed by this call.
+ */
+void nxai_shm_ring_close( nxai_shm_ring_t *ring );
+
+/**
+ * @brief Marks the shared memory of a ring buffer for removal and detaches it from this process.
+ * The memory is removed when the last process detaches.
+ *
+ * @param ring The ring buffer, freed by this call.
+ * @return The return value of the shmctl system call.
+ */
+int nxai_shm_ring_destroy( nxai_shm_ring_t *ring );
+
+/**
+ * @brief Creates a pool of frame slots for handing frames between processes without copying.
+ *
+ * The shared memory holds `num_slots` slots of `slot_size` bytes, each with a state that moves from
+ * free to writing to ready to reading and back to free. A producer acquires a free slot, writes a frame
+ * into it and publishes it. A consumer takes the oldest published frame, uses it in place and releases
+ * the slot. With two or three slots the producer can write the next frame while the consumer still
+ * works on the previous one. Any number of threads or processes can produce and consume.
+ *
+ * @param shm_key The key of the shared memory segment, other processes attach with the same key.
+ * @param num_slots The number of slots.
+ * @param slot_size The size of the largest frame. Slots are aligned to 64 bytes.
+ *
+ * @return The frame pool, or NULL if it could not be created. Release with `nxai_shm_frame_pool_close`
+ *         or `nxai_shm_frame_pool_destroy`.
+ */
+nxai_shm_frame_pool_t *nxai_shm_frame_pool_create( key_t shm_key, uint32_t num_slots, size_t slot_size );
+
+/**
+ * @brief Attaches to a frame pool created by another process with `nxai_shm_frame_pool_create`.
+ *
+ * @param shm_key The key the frame pool was created with.
+ *
+ * @return The frame pool, or NULL if it does not exist or is not initialised.
+ */
+nxai_shm_frame_pool_t *nxai_shm_frame_pool_attach( key_t shm_key );
+
+/**
+ * @brief Sets how long acquiring waits for a free slot and taking waits for a frame. Defaults to 1 second.
+ *
+ * @param pool The frame pool.
+ * @param timeout_ms The timeout in milliseconds.
+ */
+void nxai_shm_frame_pool_set_timeout( nxai_shm_frame_pool_t *pool, uint32_t timeout_ms );
+
+/**
+ * @brief Returns the id of the shared memory segment holding the frame pool.
+ *
+ * @param pool The frame pool.
+ * @return The shared memory id.
+ */
+int nxai_shm_frame_pool_get_id( nxai_shm_frame_pool_t *pool );
+
+/**
+ * @brief Returns the size of the largest frame that fits in a slot.
+ *
+ * @param pool The frame pool.
+ * @return The slot size in bytes.
+ */
+size_t nxai_shm_frame_pool_get_slot_size( nxai_shm_frame_pool_t *pool );
+
+/**
+ * @brief Acquires a free slot to write a frame into.
+ *
+ * Waits for a slot to be released when all are in use, up to the timeout.
+ *
+ * @param pool The frame pool.
+ * @param slot Set to the acquired slot, pass it to `nxai_shm_frame_pool_publish`.
+ *
+ * @return The slot memory of `nxai_shm_frame_pool_get_slot_size` bytes, or NULL if the timeout passed.
+ */
+char *nxai_shm_frame_pool_acquire( nxai_shm_frame_pool_t *pool, uint32_t *slot );
+
+/**
+ * @brief Publishes the frame written into an acquired slot, handing the slot to the consumers.
+ *
+ * @param pool The frame pool.
+ * @param slot The slot returned by `nxai_shm_frame_pool_acquire`.
+ * @param frame_length The length of the frame.
+ *
+ * @return true if the frame was published, false if the slot was not acquired or the frame is too large.
+ */
+bool nxai_shm_frame_pool_publish( nxai_shm_frame_pool_t *pool, uint32_t slot, uint32_t frame_length );
+
+/**
+ * @brief Takes the oldest published frame for reading.
+ *
+ * Waits for a frame to be published when none is ready, up to the timeout. The frame stays valid until
+ * the slot is released.
+ *
+ * @param pool The frame pool.
+ * @param slot Set to the slot of the frame, pass it to `nxai_shm_frame_pool_release`.
+ * @param frame_length Set to the length of the frame. Set to 0 on failure.
+ *
+ * @return The frame, or NULL if the timeout passed.
+ */
+const char *nxai_shm_frame_pool_take( nxai_shm_frame_pool_t *pool, uint32_t *slot, uint32_t *frame_length );
+
+/**
+ * @brief Releases a taken slot, so producers can reuse it.
+ *
+ * @param pool The frame pool.
+ * @param slot The slot returned by `nxai_shm_frame_pool_take`.
+ *
+ * @return true if the slot was released, false if it was not taken.
+ */
+bool nxai_shm_frame_pool_release( nxai_shm_frame_pool_t *pool, uint32_t slot );
+
+/**
+ * @brief Detaches a frame pool from this process. The shared memory remains for other processes.
+ *
+ * @param pool The frame pool, freed by this call.
+ */
+void nxai_shm_frame_pool_close( nxai_shm_frame_pool_t *pool );
+
+/**
+ * @brief Marks the shared memory of a frame pool for removal and detaches it from this process.
+ * The memory is removed when the last process detaches.
+ *
+ * @param pool The frame pool, freed by this call.
+ * @return The return value of the shmctl system call.
+ */
+int nxai_shm_frame_pool_destroy( nxai_shm_frame_pool_t *pool );
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -7,14 +7,119 @@ extern "C" {
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/**
+ * @brief Maximum size of a message sent as a single `SOCK_SEQPACKET` packet.
+ * Larger messages need the default `SOCK_STREAM` transport.
+ */
+#define NXAI_SOCKET_MAX_PACKET_SIZE 65536
+
+/**
+ * @brief Maximum number of segments in a scatter/gather message.
+ */
+#define NXAI_SOCKET_MAX_SEGMENTS 64
+
+/**
+ * @brief Maximum number of file descriptors that can be attached to a single message.
+ */
+#define NXAI_SOCKET_MAX_FDS 16
+
+/**
+ * @brief Collects small messages and sends them as a single batch message.
+ *
+ * A batch message is a normal length prefixed message, whose payload starts with a magic number and
+ * the record count, followed by every record with its own 4-byte length header. Receivers can not tell
+ * a batch from other messages, so batches are only sent to connections that carry nothing else, for
+ * example to `nxai_socket_start_batch_listener`.
+ * Initialise with `nxai_socket_batch_init`, and release with `nxai_socket_batch_free`.
+ */
+typedef struct {
+    int connection_fd;
+    char *buffer;
+    size_t allocated_buffer_size;
+    size_t used;
+    uint32_t num_records;
+    size_t flush_size;
+    uint64_t max_latency_us;
+    uint64_t first_record_timestamp_us;
+} nxai_socket_batch_t;
+
+/**
+ * @brief Number of buckets in the latency histograms of `nxai_socket_metrics_t`.
+ *
+ * Bucket 0 counts durations below 1 µs, bucket `i` counts durations from 2^(i-1) up to 2^i µs.
+ * The last bucket also counts everything longer.
+ */
+#define NXAI_SOCKET_METRICS_HISTOGRAM_BUCKETS 32
+
+/**
+ * @brief Snapshot of the socket metrics of this process, see `nxai_socket_get_metrics`.
+ *
+ * Counters only ever increase, rates follow from the difference between two snapshots.
+ */
+typedef struct {
+    // Messages and payload bytes sent and received, on connections and by listeners
+    uint64_t messages_sent;
+    uint64_t bytes_sent;
+    uint64_t messages_received;
+    uint64_t bytes_received;
+    // Messages that were dropped after part of them was received
+    uint64_t partial_reads;
+    // Sends and receives that ran into a timeout or deadline
+    uint64_t timeouts;
+    // Sends and receives that failed for another reason than a timeout or the peer closing the connection
+    uint64_t send_errors;
+    uint64_t receive_errors;
+    // Receive buffers that were reallocated to fit a larger message
+    uint64_t buffer_reallocations;
+    // Connections accepted and closed by listeners
+    uint64_t connections_accepted;
+    uint64_t connections_closed;
+    // Time from a listener accepting a connection to the start of the first callback for it
+    uint64_t accept_to_callback_us[NXAI_SOCKET_METRICS_HISTOGRAM_BUCKETS];
+    // Time spent in listener callbacks
+    uint64_t callback_duration_us[NXAI_SOCKET_METRICS_HISTOGRAM_BUCKETS];
+} nxai_socket_metrics_t;
+
+/**
+ * @brief Asynchronous socket client, see `nxai_socket_async_client_create`.
+ */
+typedef struct nxai_socket_async_client nxai_socket_async_client_t;
+
+/**
+ * @brief Called when the response to an asynchronous request arrives.
+ *
+ * @param request_id The id returned by `nxai_socket_async_submit`.
+ * @param response The response, only valid during the callback. NULL if the request failed.
+ * @param response_length The length of the response.
+ * @param user_data The pointer passed to `nxai_socket_async_submit`.
+ */
+typedef void ( *nxai_socket_async_callback_t )( uint64_t request_id, const char *response, uint32_t response_length, void *user_data );
+
+/**
+ * @brief Pool of receive buffers in power of two size classes, see `nxai_socket_buffer_pool_create`.
+ */
+typedef struct nxai_socket_buffer_pool nxai_socket_buffer_pool_t;
 
 /**
  * @brief A boolean that can be used to interrupt the socket listener.
  * By default creating a socket listener will listen for new connections in a loop.
  * By setting this variable to true, this loop will be interrupted and the socket destroyed.
+ * Listeners only check this variable when they wake up, use `nxai_socket_interrupt_listeners` to wake them immediately.
  */
 extern bool nxai_socket_interrupt_signal;
 
+/**
+ * @brief Interrupts all socket listeners in this process.
+ *
+ * Sets `nxai_socket_interrupt_signal` and wakes up every running listener through a process wide eventfd,
+ * so listeners stop without waiting for a timeout. Safe to call from another thread.
+ * To start listeners again afterwards, reset `nxai_socket_interrupt_signal` to false first.
+ */
+void nxai_socket_interrupt_listeners( void );
+
 /**
  * @brief Create a UNIX socket and start listening on it.
  *
@@ -37,6 +142,18 @@ extern bool nxai_socket_interrupt_signal;
  */
 int nxai_socket_create_listener( const char *socket_path );
 
+/**
+ * @brief Create a UNIX socket of a given type and start listening on it.
+ *
+ * Works like `nxai_socket_create_listener`, but allows choosing the socket type.
+ *
+ * @param[in] socket_path The path at which to create the socket.
+ * @param[in] socket_type `SOCK_STREAM` for length prefixed messages, or `SOCK_SEQPACKET` for one message per packet.
+ *
+ * @return The file descriptor for the new socket, or -1 if an error occurred.
+ */
+int nxai_socket_create_listener_with_type( const char *socket_path, int socket_type );
+
 /**
  * @brief Receives a socket message on a given connection.
  * 
@@ -45,12 +162,163 @@ int nxai_socket_create_listener( const char *socket_path );
  * the function reallocates the buffer to fit the message. It then reads the message into the buffer.
  * If an error occurs during socket reading, a warning message is printed to stderr.
  *
+ * The connection is left open, so it can be used to receive further messages.
+ *
+ * @param connection_fd The file descriptor for the connection on which to receive messages.
+ * @param allocated_buffer_size A pointer to the size of the allocated buffer.
+ * @param message_input_buffer A pointer to the input buffer in which to store the received message.
+ * @param message_length A pointer to a variable in which to store the length of the received message. Set to 0 on failure.
+ *
+ * @return true if a complete message was received, false if the peer closed the connection, the receive timed out or the message was incomplete.
+ */
+bool nxai_socket_receive_on_connection( int connection_fd, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length );
+
+/**
+ * @brief Receives a socket message and the file descriptors attached to it.
+ * 
+ * Works like `nxai_socket_receive_on_connection`, but also receives file descriptors sent with
+ * `nxai_socket_send_with_fds_to_connection` using `SCM_RIGHTS`. The received descriptors are new
+ * descriptors in this process, refer to the same open files as the sender's, and are owned by the caller.
+ * Descriptors that do not fit in `received_fds` are closed.
+ * 
+ * @param connection_fd The file descriptor for the connection on which to receive messages.
+ * @param allocated_buffer_size A pointer to the size of the allocated buffer.
+ * @param message_input_buffer A pointer to the input buffer in which to store the received message.
+ * @param message_length A pointer to a variable in which to store the length of the received message. Set to 0 on failure.
+ * @param received_fds Array in which to store the received file descriptors. Can be NULL to close any received descriptors.
+ * @param num_received_fds On input the capacity of `received_fds`, on output the number of descriptors received.
+ * 
+ * @return true if a complete message was received, false otherwise. No descriptors are returned on failure.
+ */
+bool nxai_socket_receive_with_fds_on_connection( int connection_fd, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length, int *received_fds, size_t *num_received_fds );
+
+/**
+ * @brief Creates a pool of reusable receive buffers.
+ * 
+ * Buffers are handed out in power of two size classes from 1 KB up to 64 MB, so a buffer released after
+ * a large message is reused for the next large message instead of growing every caller's buffer.
+ * Released buffers are kept for reuse until `max_cached_bytes` is reached, after that they are freed,
+ * which bounds the memory held by the pool. Larger requests are allocated and freed directly.
+ * The pool can be used from multiple threads, so a buffer can be released by another thread than the
+ * one that acquired it.
+ * 
+ * @param max_cached_bytes Maximum number of bytes kept in released buffers.
+ * @return The new pool, or NULL if it could not be allocated.
+ */
+nxai_socket_buffer_pool_t *nxai_socket_buffer_pool_create( size_t max_cached_bytes );
+
+/**
+ * @brief Frees a buffer pool and all buffers cached in it.
+ * Buffers that are still acquired must be released before the pool is destroyed.
+ * 
+ * @param pool The pool to destroy.
+ */
+void nxai_socket_buffer_pool_destroy( nxai_socket_buffer_pool_t *pool );
+
+/**
+ * @brief Takes a buffer of at least `size` bytes from the pool.
+ * 
+ * @param pool The pool to take the buffer from. If NULL, the buffer is allocated and freed without caching.
+ * @param size The minimum size of the buffer.
+ * @return The buffer, or NULL if it could not be allocated. Return it with `nxai_socket_buffer_release`.
+ */
+char *nxai_socket_buffer_acquire( nxai_socket_buffer_pool_t *pool, size_t size );
+
+/**
+ * @brief Returns the usable size of an acquired buffer, which can be larger than was requested.
+ * 
+ * @param buffer A buffer returned by `nxai_socket_buffer_acquire`.
+ * @return The usable size of the buffer in bytes.
+ */
+size_t nxai_socket_buffer_capacity( const char *buffer );
+
+/**
+ * @brief Returns a buffer to the pool it was acquired from.
+ * 
+ * @param pool The pool the buffer was acquired from.
+ * @param buffer The buffer to return. Does nothing if NULL.
+ */
+void nxai_socket_buffer_release( nxai_socket_buffer_pool_t *pool, char *buffer );
+
+/**
+ * @brief Receives a socket message into a buffer acquired from a pool.
+ * 
+ * Works like `nxai_socket_receive_on_connection`, but every message is received in its own buffer,
+ * which the caller owns until it is returned with `nxai_socket_buffer_release`. The message can thus
+ * be handed to another thread without copying while the next message is received.
+ * File descriptors sent with the message are closed.
+ * 
+ * @param connection_fd The file descriptor for the connection on which to receive messages.
+ * @param pool The pool to acquire the buffer from.
+ * @param message Set to the buffer holding the received message, or NULL on failure.
+ * @param message_length A pointer to a variable in which to store the length of the received message. Set to 0 on failure.
+ * 
+ * @return true if a complete message was received, false otherwise.
+ */
+bool nxai_socket_receive_pooled_on_connection( int connection_fd, nxai_socket_buffer_pool_t *pool, char **message, uint32_t *message_length );
+
+/**
+ * @brief Called with each piece of a message received by `nxai_socket_receive_streaming_on_connection`.
+ *
+ * @param chunk The next part of the message, only valid during the callback.
+ * @param chunk_length The length of the part.
+ * @param offset The position of the part in the message.
+ * @param message_length The length of the whole message.
+ * @param user_data The pointer passed to `nxai_socket_receive_streaming_on_connection`.
+ *
+ * @return true to continue receiving, false to stop.
+ */
+typedef bool ( *nxai_socket_chunk_callback_t )( const char *chunk, uint32_t chunk_length, uint32_t offset, uint32_t message_length, void *user_data );
+
+/**
+ * @brief Receives a socket message in pieces, without holding the whole message in memory.
+ *
+ * The message is handed to `chunk_callback` in order, in pieces of up to 64 KB, for example to write it
+ * into shared memory or a file. Use this for messages that may be too large to receive in memory, it is
+ * not limited by `nxai_socket_set_max_message_size`. File descriptors sent with the message are closed.
+ *
+ * If the callback stops the receive or the connection drops, the rest of the message is not read and
+ * the connection should be closed.
+ *
+ * @param connection_fd The file descriptor for the connection on which to receive messages.
+ * @param chunk_callback Function called with each piece of the message. Not called for an empty message.
+ * @param user_data Pointer passed to the callback.
+ * @param message_length A pointer to a variable in which to store the length of the received message. Set to 0 on failure.
+ *
+ * @return true if the complete message was received, false otherwise. errno is ECANCELED if the callback stopped the receive.
+ */
+bool nxai_socket_receive_streaming_on_connection( int connection_fd, nxai_socket_chunk_callback_t chunk_callback, void *user_data, uint32_t *message_length );
+
+/**
+ * @brief Receives a socket message, giving up when a deadline passes.
+ * 
+ * Works like `nxai_socket_receive_on_connection`, but waits until an absolute deadline instead of
+ * the socket's receive timeout, so a latency critical caller can give up within milliseconds while
+ * other calls on the same connection wait longer. The socket options are not changed.
+ * If no part of the message arrived before the deadline, false is returned with `errno` set to `EAGAIN`
+ * and the connection can still be used. If the deadline passes halfway through a message, `errno` is
+ * set to `ETIMEDOUT` and the connection should be closed.
+ * 
  * @param connection_fd The file descriptor for the connection on which to receive messages.
+ * @param deadline_us Absolute deadline in microseconds on the monotonic clock of `nxai_monotonic_timestamp_us`.
+ *                    A deadline in the past only receives a message that is already available.
  * @param allocated_buffer_size A pointer to the size of the allocated buffer.
  * @param message_input_buffer A pointer to the input buffer in which to store the received message.
- * @param message_length A pointer to a variable in which to store the length of the received message.
+ * @param message_length A pointer to a variable in which to store the length of the received message. Set to 0 on failure.
+ * 
+ * @return true if a complete message was received before the deadline, false otherwise.
  */
-void nxai_socket_receive_on_connection( int connection_fd, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length );
+bool nxai_socket_receive_with_deadline_on_connection( int connection_fd, uint64_t deadline_us, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length );
+
+/**
+ * @brief Waits until a message can be received on a connection.
+ * 
+ * @param connection_fd The file descriptor of an open connection.
+ * @param timeout_us Maximum time to wait in microseconds. With 0 the connection is only checked.
+ * 
+ * @return true if data is available or the peer closed the connection, false if the timeout passed.
+ */
+bool nxai_socket_poll_connection( int connection_fd, uint32_t timeout_us );
 
 /**
  * \brief Waits for an incoming socket message, reads it and saves it to the provided buffer.
@@ -82,6 +350,15 @@ int nxai_socket_await_message( int socket_fd, size_t *allocated_buffer_size, cha
  * to the specified path and sets it to listen mode. The socket's file permissions are 
  * changed to allow anyone to write to it. The function also sets a timeout for the socket.
  * 
+ * Connections are persistent: after the callback returns the connection stays open and
+ * further messages on it are passed to the callback as well. A connection is closed when
+ * the peer closes it, so clients can send many messages over one connection.
+ * 
+ * All connections are non-blocking and multiplexed through epoll on the calling thread, and
+ * messages that arrive in pieces are reassembled per connection, so one slow sender does not
+ * stall the others. The message passed to the callback is only valid during the callback.
+ * The listener returns after `nxai_socket_interrupt_listeners` is called.
+ * 
  * @param socket_path The path of the Unix socket to create and listen on.
  * 
  * @return The file descriptor for the newly created socket, or -1 if an error occurred during 
@@ -89,6 +366,92 @@ int nxai_socket_await_message( int socket_fd, size_t *allocated_buffer_size, cha
  */
 void nxai_socket_start_listener( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int ) );
 
+/**
+ * @brief Listens on a `SOCK_SEQPACKET` socket, where every packet is one message.
+ * 
+ * Works like `nxai_socket_start_listener`, but messages are not length prefixed: the socket keeps
+ * message boundaries, so every message is received with a single call and without reassembly.
+ * Messages are at most `NXAI_SOCKET_MAX_PACKET_SIZE` bytes. Clients connect with
+ * `nxai_socket_connect_with_type`, and both sides send with `nxai_socket_send_packet_to_connection`.
+ * 
+ * @param socket_path The path of the Unix socket to create and listen on.
+ * @param callback_function Function called for every message.
+ */
+void nxai_socket_start_packet_listener( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int ) );
+
+/**
+ * @brief Listens on a socket for batch messages, and runs the callback for every record in them.
+ *
+ * Works like `nxai_socket_start_listener`, but every message must be a batch sent with
+ * `nxai_socket_batch_flush` or `nxai_socket_send_batch`. Other messages are ignored with a warning.
+ *
+ * @param socket_path The path of the Unix socket to create and listen on.
+ * @param callback_function Function called for every record with the record, its length and the connection.
+ */
+void nxai_socket_start_batch_listener( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int ) );
+
+/**
+ * @brief Listens on a socket and passes received file descriptors to the callback.
+ * 
+ * Works like `nxai_socket_start_listener`, but the callback also receives the file descriptors that
+ * were attached to the message with `nxai_socket_send_with_fds_to_connection`. The callback owns the
+ * descriptors and must close them. Other listeners close descriptors they receive.
+ * 
+ * @param socket_path The path of the Unix socket to create and listen on.
+ * @param callback_function Function called for every message with the message, its length, the connection
+ *                          and the received file descriptors with their count.
+ */
+void nxai_socket_start_fd_listener( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int, const int *, size_t ) );
+
+/**
+ * @brief Listens on a socket like `nxai_socket_start_listener`, using io_uring to accept and receive.
+ * 
+ * Connections are accepted and read with multishot io_uring operations into buffers provided to the
+ * kernel up front, which saves a system call per read on busy connections. The callback is run on the
+ * listener thread and can reply on `connection_fd` as usual. File descriptors sent with messages are
+ * not received and are closed by the kernel, use `nxai_socket_start_fd_listener` to receive them.
+ * Falls back to `nxai_socket_start_listener` when the kernel or the build does not support io_uring.
+ * 
+ * @param socket_path The path of the Unix socket to create and listen on.
+ * @param callback_function Function called for every message with the message, its length and the connection.
+ */
+void nxai_socket_start_uring_listener( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int ) );
+
+/**
+ * @brief Listens on a socket and runs the callback on a pool of worker threads.
+ * 
+ * Works like `nxai_socket_start_listener`, but the event loop only receives messages and hands them
+ * to worker threads, so processing one message does not block reception of the next.
+ * Workers share one bounded queue, but a connection is only handled by one worker at a time, so
+ * messages of a connection are handled in order and the callback can reply on `connection_fd` as usual.
+ * When the queue is full the event loop waits, which stops reading from the sockets and pushes back
+ * on the senders. Connections are closed after all their queued messages are handled.
+ * 
+ * @param socket_path The path of the Unix socket to create and listen on.
+ * @param callback_function Function called for every message, from one of the worker threads.
+ * @param num_workers Number of worker threads to start.
+ * @param queue_length Maximum number of messages waiting for a worker.
+ */
+void nxai_socket_start_listener_pool( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int ), size_t num_workers, size_t queue_length );
+
+/**
+ * @brief Listens on a socket and reads ahead a bounded number of requests per connection.
+ * 
+ * Works like `nxai_socket_start_listener_pool`, so a client can pipeline requests on one connection:
+ * while a worker handles one request, the next ones are read and queued, and the responses the
+ * callback sends on `connection_fd` go out in request order. Reading from a connection pauses once
+ * `pipeline_depth` of its requests are queued or being handled, and resumes when a worker catches up,
+ * so one busy client can not fill the shared queue. Requests that arrive in the same read as the last
+ * one allowed are still queued.
+ * 
+ * @param socket_path The path of the Unix socket to create and listen on.
+ * @param callback_function Function called for every message, from one of the worker threads.
+ * @param num_workers Number of worker threads to start.
+ * @param queue_length Maximum number of messages waiting for a worker, over all connections.
+ * @param pipeline_depth Maximum number of requests read ahead per connection.
+ */
+void nxai_socket_start_pipelined_listener( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int ), size_t num_workers, size_t queue_length, size_t pipeline_depth );
+
 /**
  * @brief Connects to a Unix domain socket at a given path.
  * 
@@ -103,6 +466,68 @@ void nxai_socket_start_listener( const char *socket_path, void ( *callback_funct
  */
 int32_t nxai_socket_connect( const char *socket_path );
 
+/**
+ * @brief Connects to a Unix domain socket of a given type at a given path.
+ * 
+ * Works like `nxai_socket_connect`, but allows choosing the socket type, which must match the listener.
+ * 
+ * @param socket_path The file system path to the Unix domain socket.
+ * @param socket_type `SOCK_STREAM` or `SOCK_SEQPACKET`.
+ * 
+ * @return socket_fd on successful connection, -1 on any failure.
+ */
+int32_t nxai_socket_connect_with_type( const char *socket_path, int socket_type );
+
+/**
+ * @brief Connects to a Unix domain socket, waiting at most `timeout_ms` for the listener to accept.
+ * 
+ * Works like `nxai_socket_connect`. Connecting only waits when the listener's backlog is full, which
+ * otherwise blocks for the full default timeout.
+ * 
+ * @param socket_path The file system path to the Unix domain socket.
+ * @param timeout_ms Maximum time to wait for the connection in milliseconds.
+ * 
+ * @return socket_fd on successful connection, -1 on any failure.
+ */
+int32_t nxai_socket_connect_with_timeout( const char *socket_path, uint32_t timeout_ms );
+
+/**
+ * @brief Sets the send and receive timeout for sockets created from now on.
+ * 
+ * The timeout is applied once when a socket is connected or a listener is created, and accepted
+ * connections inherit it from their listener. It defaults to 1 second. Call this before creating
+ * sockets, it is not synchronised with other threads.
+ * 
+ * @param timeout_ms The timeout in milliseconds. 0 waits forever.
+ */
+void nxai_socket_set_default_timeout( uint32_t timeout_ms );
+
+/**
+ * @brief Sets the size of the largest message that is received into memory.
+ * 
+ * Receiving trusts the length in the message header, so without a limit a single peer can make the
+ * receiver allocate up to 4 GB. Larger messages are refused by the receive functions with errno set
+ * to EMSGSIZE, without reading them, so the connection should be closed. Listeners close the
+ * connection. `nxai_socket_receive_streaming_on_connection` is not limited. There is no limit by
+ * default. Call this before receiving, it is not synchronised with other threads.
+ * 
+ * @param max_bytes The largest message length accepted.
+ */
+void nxai_socket_set_max_message_size( uint32_t max_bytes );
+
+/**
+ * @brief Sets the send and receive timeout of a single socket.
+ * 
+ * Use this to give one connection a different timeout than the default, or to give sockets that were
+ * not created by these utilities a timeout at all.
+ * 
+ * @param connection_fd The file descriptor of the socket.
+ * @param timeout_ms The timeout in milliseconds. 0 waits forever.
+ * 
+ * @return true if the timeout was set.
+ */
+bool nxai_socket_set_timeout( int connection_fd, uint32_t timeout_ms );
+
 /**
  * @brief Send a string to a socket
  *
@@ -126,12 +551,28 @@ void nxai_socket_send( const char *socket_path, const char *string_to_send, uint
  */
 uint32_t nxai_socket_send_receive_message( const char *socket_path, const char *message_to_send, const uint32_t sending_message_length, char **return_message_buffer, size_t *allocated_message_length );
 
+/**
+ * @brief Sends a message and receives a response on an open connection.
+ * 
+ * This is the persistent connection counterpart of `nxai_socket_send_receive_message`. The connection
+ * is opened once with `nxai_socket_connect`, can be used for many request/response pairs, and is
+ * closed by the caller with `close` when no longer needed.
+ * 
+ * @param connection_fd The file descriptor of an open connection.
+ * @param message_to_send Message to send through the socket.
+ * @param sending_message_length Length of the message to send.
+ * @param return_message_buffer Pointer to buffer that will hold the received message. Can be NULL or a reusable buffer.
+ * @param allocated_message_length Pointer to how much space in the existing buffer is allocated. If too small, or `return_message_buffer` is NULL, `return_message_buffer` will be reallocated and this variable updated.
+ * @return Returns the length of the received message or 0 if there was an error. On error the connection should be closed.
+ */
+uint32_t nxai_socket_send_receive_on_connection( const int connection_fd, const char *message_to_send, const uint32_t sending_message_length, char **return_message_buffer, size_t *allocated_message_length );
+
 /**
  * @brief Sends a message to a socket
  *
  * This function sends a message to a given socket. The message to send and its length are also parameters
  * of the function. It first sets the socket options, then sends the length of the message as a header 
- * and finally sends the actual message. If any of the send operations fail, the function will return false.
+ * together with the actual message in one `sendmsg` call. If any of the send operations fail, the function will return false.
  *
  * @param connection_fd The file descriptor of the connection to send the message to
  * @param message_to_send The message to be sent to the socket
@@ -141,6 +582,252 @@ uint32_t nxai_socket_send_receive_message( const char *socket_path, const char *
  */
 bool nxai_socket_send_to_connection( const int connection_fd, const char *message_to_send, uint32_t message_length );
 
+/**
+ * @brief Sends a message made up of several segments.
+ *
+ * The segments are sent as a single message, as if they were concatenated into one buffer first.
+ * The length header and all segments are passed to the kernel in one `sendmsg` call, so for example
+ * a msgpack header and a raw tensor can be sent without copying them together.
+ *
+ * @param connection_fd The file descriptor of the connection to send the message to
+ * @param segments The segments of the message, in order
+ * @param num_segments The number of segments, at most `NXAI_SOCKET_MAX_SEGMENTS`
+ *
+ * @return true if the message was successfully sent, false otherwise
+ */
+bool nxai_socket_sendv_to_connection( const int connection_fd, const struct iovec *segments, size_t num_segments );
+
+/**
+ * @brief Sends a message on a connection, giving up when a deadline passes.
+ * 
+ * Works like `nxai_socket_send_to_connection`, but waits until an absolute deadline instead of the
+ * socket's send timeout. If the deadline passes after part of the message was sent, the connection
+ * should be closed.
+ * 
+ * @param connection_fd The file descriptor of an open connection.
+ * @param message_to_send Message to send.
+ * @param message_length Length of the message to send.
+ * @param deadline_us Absolute deadline in microseconds on the monotonic clock of `nxai_monotonic_timestamp_us`.
+ * 
+ * @return true if the message was sent before the deadline, false otherwise.
+ */
+bool nxai_socket_send_with_deadline_to_connection( const int connection_fd, const char *message_to_send, uint32_t message_length, uint64_t deadline_us );
+
+/**
+ * @brief Sends a message as a single packet on a `SOCK_SEQPACKET` connection.
+ *
+ * The message is sent without length header in one atomic `send`.
+ *
+ * @param connection_fd The file descriptor of the connection to send the message to
+ * @param message_to_send The message to be sent to the socket
+ * @param message_length The length of the message, between 1 and `NXAI_SOCKET_MAX_PACKET_SIZE` bytes
+ *
+ * @return true if the message was successfully sent, false otherwise
+ */
+bool nxai_socket_send_packet_to_connection( const int connection_fd, const char *message_to_send, uint32_t message_length );
+
+/**
+ * @brief Receives a single packet message on a `SOCK_SEQPACKET` connection.
+ *
+ * The buffer is grown to `NXAI_SOCKET_MAX_PACKET_SIZE` bytes if it is smaller, so every packet is received
+ * with one `recv` call.
+ *
+ * @param connection_fd The file descriptor for the connection on which to receive the message.
+ * @param allocated_buffer_size A pointer to the size of the allocated buffer.
+ * @param message_input_buffer A pointer to the input buffer in which to store the received message.
+ * @param message_length A pointer to a variable in which to store the length of the received message. Set to 0 on failure.
+ *
+ * @return true if a message was received, false if the peer closed the connection or the receive failed.
+ */
+bool nxai_socket_receive_packet_on_connection( int connection_fd, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length );
+
+/**
+ * @brief Receives a message into several caller provided segments.
+ *
+ * After reading the length header, the message is scattered over the segments in order with `recvmsg`,
+ * so for example a fixed size metadata header and a tensor can be received into separate buffers.
+ * If the message is shorter than the segments, only the first `message_length` bytes are filled.
+ * If it is longer, the rest of the message is discarded and false is returned.
+ *
+ * @param connection_fd The file descriptor for the connection on which to receive the message.
+ * @param segments The buffers to receive the message into, in order.
+ * @param num_segments The number of segments, at most `NXAI_SOCKET_MAX_SEGMENTS`.
+ * @param message_length A pointer to a variable in which to store the length of the received message. Set to 0 on failure.
+ *
+ * @return true if a complete message was received into the segments, false otherwise.
+ */
+bool nxai_socket_receivev_on_connection( int connection_fd, const struct iovec *segments, size_t num_segments, uint32_t *message_length );
+
+/**
+ * @brief Sends a message with file descriptors attached to it.
+ *
+ * The descriptors are passed to the receiving process with `SCM_RIGHTS`, so buffers such as memfd or
+ * SHM file descriptors can be shared without copying their contents through the socket.
+ * The descriptors stay open in this process, the receiver gets its own copies.
+ *
+ * @param connection_fd The file descriptor of the connection to send the message to
+ * @param message_to_send The message to be sent to the socket
+ * @param message_length The length of the message to be sent
+ * @param fds_to_send The file descriptors to attach to the message
+ * @param num_fds The number of file descriptors, at most `NXAI_SOCKET_MAX_FDS`
+ *
+ * @return true if the message was successfully sent, false otherwise
+ */
+bool nxai_socket_send_with_fds_to_connection( const int connection_fd, const char *message_to_send, uint32_t message_length, const int *fds_to_send, size_t num_fds );
+
+/**
+ * @brief Initialises a batch of messages for a connection.
+ *
+ * @param batch The batch to initialise.
+ * @param connection_fd The connection the batch is sent to.
+ * @param flush_size The batch is sent as soon as it holds at least this many bytes.
+ * @param max_latency_us The batch is sent once its oldest record is older than this, checked when a record
+ *                       is appended or `nxai_socket_batch_flush_if_due` is called.
+ */
+void nxai_socket_batch_init( nxai_socket_batch_t *batch, int connection_fd, size_t flush_size, uint64_t max_latency_us );
+
+/**
+ * @brief Appends a record to a batch, and sends the batch when its size or latency bound is reached.
+ *
+ * The record is copied, so the caller can reuse its buffer immediately. Records of more than
+ * `UINT32_MAX - 12` bytes do not fit in a batch message and are rejected with errno EMSGSIZE.
+ *
+ * @return false if the record could not be stored or the batch could not be sent, true otherwise.
+ */
+bool nxai_socket_batch_append( nxai_socket_batch_t *batch, const char *record, uint32_t record_length );
+
+/**
+ * @brief Sends the batch if its oldest record has waited longer than the latency bound.
+ *
+ * Call this periodically when records arrive irregularly, so a partial batch is not held back.
+ *
+ * @return false if sending failed, true otherwise.
+ */
+bool nxai_socket_batch_flush_if_due( nxai_socket_batch_t *batch );
+
+/**
+ * @brief Sends all records collected in the batch as one message. Does nothing for an empty batch.
+ *
+ * @return false if sending failed, in which case the records are dropped. True otherwise.
+ */
+bool nxai_socket_batch_flush( nxai_socket_batch_t *batch );
+
+/**
+ * @brief Frees the buffer of a batch. Records that were not flushed are dropped.
+ */
+void nxai_socket_batch_free( nxai_socket_batch_t *batch );
+
+/**
+ * @brief Sends several records as batch messages without copying them.
+ *
+ * The records are sent with `nxai_socket_sendv_to_connection`. If there are more records than fit in
+ * the segments of one message, they are split over several batch messages.
+ *
+ * @param connection_fd The connection to send the records to.
+ * @param records The records to send.
+ * @param record_lengths The length of each record.
+ * @param num_records The number of records.
+ *
+ * @return true if all records were sent, false otherwise. Records of more than `UINT32_MAX - 12` bytes
+ *         are rejected with errno EMSGSIZE, before any record is sent.
+ */
+bool nxai_socket_send_batch( const int connection_fd, const char *const *records, const uint32_t *record_lengths, size_t num_records );
+
+/**
+ * @brief Iterates over the records of a received batch message.
+ *
+ * Only call this for messages that are batches, because the connection carries nothing else.
+ * Start with `offset` set to 0, and call repeatedly until the function returns false.
+ * The returned records point into `message`, so they are valid as long as the message is.
+ *
+ * @param message The received batch message.
+ * @param message_length The length of the message.
+ * @param offset The iteration position, set to 0 before the first call.
+ * @param record Set to the next record.
+ * @param record_length Set to the length of the next record.
+ *
+ * @return true if a record was returned, false at the end of the batch or if the message is not a valid batch.
+ */
+bool nxai_socket_batch_next( const char *message, uint32_t message_length, size_t *offset, const char **record, uint32_t *record_length );
+
+/**
+ * @brief Creates an asynchronous client for a socket.
+ *
+ * The client keeps a small number of persistent connections to the socket and a background thread that
+ * receives responses, so callers can submit requests without waiting for them. Many requests can be in
+ * flight at once. The listener answers the requests of a connection in order, which is how responses
+ * are matched to request ids. Connections are opened on first use and reopened after a failure.
+ *
+ * @param socket_path Path to the socket.
+ * @param num_connections Number of connections to spread requests over.
+ *
+ * @return The client, or NULL if it could not be created.
+ */
+nxai_socket_async_client_t *nxai_socket_async_client_create( const char *socket_path, size_t num_connections );
+
+/**
+ * @brief Submits a request without waiting for the response or for the socket.
+ *
+ * The request is written right away as far as the socket takes it, the client thread writes the rest
+ * once the socket is writable again. Each connection holds up to 4 MB of requests that are not written
+ * yet, beyond that submitting fails with errno EAGAIN until the listener catches up. Only opening a
+ * connection, on first use or after a failure, waits.
+ *
+ * When the response arrives, `callback_function` is called from the client thread. It should return
+ * quickly, since it delays the other responses. If `callback_function` is NULL, the response is queued
+ * instead, the fd from `nxai_socket_async_client_get_fd` becomes readable, and the response can be
+ * collected with `nxai_socket_async_poll_completion`. A request whose connection fails completes with
+ * a NULL response.
+ *
+ * @param client The client.
+ * @param message_to_send Message to send.
+ * @param message_length Length of the message.
+ * @param callback_function Function to call with the response, or NULL to queue the response.
+ * @param user_data Pointer passed to the callback.
+ *
+ * @return The id of the request, or 0 if it could not be sent. No completion is delivered for a request that could not be sent.
+ *         errno is EAGAIN when the connection has too many requests waiting to be written.
+ */
+uint64_t nxai_socket_async_submit( nxai_socket_async_client_t *client, const char *message_to_send, uint32_t message_length, nxai_socket_async_callback_t callback_function, void *user_data );
+
+/**
+ * @brief Gets a file descriptor that is readable while queued responses are waiting.
+ *
+ * The descriptor can be added to poll, select or epoll. Do not read from or close it.
+ */
+int nxai_socket_async_client_get_fd( nxai_socket_async_client_t *client );
+
+/**
+ * @brief Collects the next queued response of a request submitted without callback.
+ *
+ * @param client The client.
+ * @param request_id Set to the id of the completed request.
+ * @param response_buffer Buffer that will hold the response. Can be NULL or a reusable buffer, and is replaced if too small.
+ * @param allocated_buffer_size Size of the buffer, updated if the buffer is replaced.
+ * @param response_length Set to the length of the response, 0 if the request failed.
+ *
+ * @return true if a response was collected, false if none is waiting.
+ */
+bool nxai_socket_async_poll_completion( nxai_socket_async_client_t *client, uint64_t *request_id, char **response_buffer, size_t *allocated_buffer_size, uint32_t *response_length );
+
+/**
+ * @brief Closes the connections of an asynchronous client and frees it.
+ *
+ * Requests that are still waiting complete with a NULL response, queued responses are dropped.
+ */
+void nxai_socket_async_client_destroy( nxai_socket_async_client_t *client );
+
+/**
+ * @brief Copies the socket metrics of this process.
+ *
+ * Metrics are counted by all socket functions and listeners of the process. Taking a snapshot does
+ * not lock and does not slow down sockets in use. Each counter is read atomically, but counters that
+ * change while the snapshot is taken may be from slightly different moments.
+ *
+ * @param metrics Set to the current metrics.
+ */
+void nxai_socket_get_metrics( nxai_socket_metrics_t *metrics );
+
 #ifdef __cplusplus
 }
 #endif
@@ -7,6 +7,14 @@ import json
 import sysv_ipc as ipc
 import msgpack
 
+# Layout of the header at the start of shared memory segments, see nxai_shm_utils.h
+SHM_HEADER_BYTES = 64
+SHM_HEADER_SENTINEL = 0xFFFFFFFF
+SHM_HEADER_MAGIC = 0x3253584E
+
+# Maximum size of a message sent as a single SOCK_SEQPACKET packet, matches NXAI_SOCKET_MAX_PACKET_SIZE
+MAX_PACKET_SIZE = 65536
+
 
 def patchSettings(
     settings_contents: dict, uiprovider_url="http://127.0.0.1:8081"
@@ -44,6 +52,7 @@ def patchSettings(
 
 def startUnixSocketServer(
     socket_path="/opt/sclbl/sockets/output_socket.sock",
+    socket_type=socket.SOCK_STREAM,
 ) -> socket.socket:
     """
     This function creates and starts a Unix socket server.
@@ -51,6 +60,8 @@ def startUnixSocketServer(
     Parameters:
     socket_path (str): The path where the Unix socket file is to be created.
                        Default is "/opt/sclbl/sockets/output_socket.sock"
+    socket_type (int): socket.SOCK_STREAM for length prefixed messages, or socket.SOCK_SEQPACKET
+                       for one message per packet. Default is socket.SOCK_STREAM
 
     Returns:
     socket.socket: a socket object representing the server
@@ -76,7 +87,7 @@ def startUnixSocketServer(
             raise
 
     # Create the Unix socket server
-    server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    server = socket.socket(socket.AF_UNIX, socket_type)
 
     # Bind the socket to the path
     server.bind(socket_path)
@@ -97,11 +108,17 @@ def receiveMessageOverConnection(connection) -> bytes:
     message length. If no data is received in a round, it breaks the loop. Finally, it
     decodes the received bytes into a UTF-8 string and returns it.
 
+    On a SOCK_SEQPACKET connection every packet is one message, so it is received
+    with a single call and without length header.
+
     :param connection: The network connection over which to receive the message
     :type connection: socket
     :return: The received message decoded as a UTF-8 string
     :rtype: str
     """
+    if connection.type == socket.SOCK_SEQPACKET:
+        return connection.recv(MAX_PACKET_SIZE)
+
     data = connection.recv(4)
     message_length = struct.unpack("<I", data)[0]
 
@@ -148,6 +165,7 @@ def sendMessageOverConnection(connection: socket.socket, message: bytes):
     This function takes a socket connection and a message as input.
     The message is converted into bytes, and its length is calculated.
     Both the length of the message and the message itself are sent over the connection.
+    On a SOCK_SEQPACKET connection the message is sent as a single packet without length.
 
     Parameters:
     connection (socket.socket): The socket connection over which the message should be sent.
@@ -166,6 +184,10 @@ def sendMessageOverConnection(connection: socket.socket, message: bytes):
     >>> sendMessageOverConnection(connection, "Hello, World!")
     """
 
+    if connection.type == socket.SOCK_SEQPACKET:
+        connection.send(message)
+        return
+
     # Calculate the length of the message
     message_length = struct.pack("<I", len(message))
 
@@ -177,7 +199,9 @@ def sendMessageOverConnection(connection: socket.socket, message: bytes):
 
 
 def sendSocketMessage(
-    message: str, sclbl_input_socket_path: str = "/opt/sclbl/sockets/sclblmod.sock"
+    message: str,
+    sclbl_input_socket_path: str = "/opt/sclbl/sockets/sclblmod.sock",
+    socket_type: int = socket.SOCK_STREAM,
 ):
     """
     Sends a message through a socket connection to a specified Unix socket path.
@@ -186,9 +210,11 @@ def sendSocketMessage(
     :type message: str
     :param sclbl_input_socket_path: The path to the Unix socket. Default is "/opt/sclbl/sockets/sclblmod.sock".
     :type sclbl_input_socket_path: str
+    :param socket_type: socket.SOCK_STREAM or socket.SOCK_SEQPACKET, must match the listener. Default is socket.SOCK_STREAM.
+    :type socket_type: int
     :effects: Establishes a socket connection, sends the message, and then closes the connection.
     """
-    client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    client = socket.socket(socket.AF_UNIX, socket_type)
     client.settimeout(10)
     client.connect(sclbl_input_socket_path)
     sendMessageOverConnection(client, message)
@@ -316,7 +342,7 @@ def create_shm(size: int) -> ipc.SharedMemory:
     Creates a new shared memory segment with a specified size and initializes it.
 
     This function allocates a new shared memory segment with a size large enough to hold
-    the requested data plus an additional 4 bytes for a header. The header is intended
+    the requested data plus an additional 64 bytes for a header. The header is intended
     to store metadata about the data stored in the shared memory, such as its size.
 
     Parameters:
@@ -328,11 +354,11 @@ def create_shm(size: int) -> ipc.SharedMemory:
                           it will only be created if it does not already exist, and an attempt
                           to attach to an existing segment with the same key will fail.
 
-    Note: The actual size of the shared memory segment is size + 4 bytes to accommodate
-          the header.
+    Note: The actual size of the shared memory segment is size + SHM_HEADER_BYTES bytes to
+          accommodate the header.
     """
     # Add enough space for header
-    shm_size = size + 4
+    shm_size = size + SHM_HEADER_BYTES
     shm = ipc.SharedMemory(None, size=shm_size, flags=(ipc.IPC_CREAT | ipc.IPC_EXCL))
     return shm
 
@@ -342,7 +368,8 @@ def write_shm(shm: ipc.SharedMemory, data: bytes):
     Writes data to a shared memory segment.
 
     This function writes both the size of the data and the data itself to a shared memory segment.
-    The size is written first, followed by the data, ensuring that the receiver knows how much data to read.
+    A header with the 64-bit size is written first, followed by the data at a 64-byte aligned offset,
+    ensuring that the receiver knows how much data to read.
 
     @param shm SharedMemory object representing the shared memory segment to write to.
     @type shm ipc.SharedMemory
@@ -352,12 +379,14 @@ def write_shm(shm: ipc.SharedMemory, data: bytes):
     @throws Exception If an error occurs during the write operation.
     """
     data_size = len(data)
-    # Parse size to bytes
-    data_size_bytes = struct.pack("<I", data_size)
-    # Write data size
-    shm.write(data_size_bytes)
+    # Parse header to bytes
+    header_bytes = struct.pack(
+        "<IIQIHH", SHM_HEADER_SENTINEL, SHM_HEADER_MAGIC, data_size, SHM_HEADER_BYTES, 0, 0
+    )
+    # Write header
+    shm.write(header_bytes)
     # Write data
-    shm.write(data, offset=4)
+    shm.write(data, offset=SHM_HEADER_BYTES)
 
 
 def read_shm(shm_key: int) -> bytes:
@@ -368,18 +397,23 @@ def read_shm(shm_key: int) -> bytes:
     :return: The raw data read from the shared memory.
 
     The function first attaches to the shared memory using the provided key.
-    It then reads the size of the data to be read from the first 4 bytes of the shared memory.
+    It then reads the size and offset of the data from the header of the shared memory.
+    Segments written in the old format, which start with a 4-byte size, are read as well.
     The function then reads the data of the specified size from the shared memory.
     Finally, it detaches from the shared memory and returns the raw data read from the memory.
     """
     # Attach shared memory using key
     shm = ipc.SharedMemory(shm_key, 0, 0)
-    # Read header which is always the size of the following message
-    size_buf = shm.read(4)
-    # Parse header to number
-    data_size = struct.unpack("<I", size_buf)[0]
+    # Read header, which starts with a sentinel or with the size in the old format
+    data_size = struct.unpack("<I", shm.read(4))[0]
+    data_offset = 4
+    if data_size == SHM_HEADER_SENTINEL:
+        magic, size, offset = struct.unpack("<IQI", shm.read(16, offset=4))
+        if magic == SHM_HEADER_MAGIC:
+            data_size = size
+            data_offset = offset
     # Read data of size
-    buf = shm.read(data_size, offset=4)
+    buf = shm.read(data_size, offset=data_offset)
     # Detach from memory again
     shm.detach()
     # Return the raw data read from memory
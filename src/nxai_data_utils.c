@@ -1,5 +1,6 @@
 #include "nxai_data_utils.h"
 #include "nxai_process_utils.h"
+#include "nxai_shm_utils.h"
 
 #include <errno.h>
 #include <stdbool.h>
@@ -182,4 +183,26 @@ void copy_mpack_object_recursive( mpack_node_t node, mpack_writer_t *writer ) {
             nxai_vlog( "Warning! Unknown mpack type: %d\n", node_type );
             break;
     }
-}
\ No newline at end of file
+}
+
+bool nxai_shm_mpack_writer_init( mpack_writer_t *writer, int shm_id ) {
+    size_t capacity;
+    char *payload = nxai_shm_reserve( shm_id, &capacity );
+    if ( payload == NULL ) {
+        return false;
+    }
+    // Without a flush function the writer fails instead of writing past the capacity
+    mpack_writer_init( writer, payload, capacity );
+    return true;
+}
+
+bool nxai_shm_mpack_writer_commit( mpack_writer_t *writer ) {
+    char *payload = writer->buffer;
+    size_t size = mpack_writer_buffer_used( writer );
+    if ( mpack_writer_destroy( writer ) != mpack_ok ) {
+        nxai_vlog( "Problem writing data: %s\n", mpack_error_to_string( mpack_writer_error( writer ) ) );
+        nxai_shm_cancel( payload );
+        return false;
+    }
+    return nxai_shm_commit( payload, size );
+}
@@ -14,6 +14,7 @@
 #include <strings.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #ifdef NXAI_DEBUG
@@ -48,6 +49,12 @@ uint64_t nxai_current_timestamp_us() {
     return microseconds;
 }
 
+uint64_t nxai_monotonic_timestamp_us() {
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );// not affected by changes to the system clock
+    return (uint64_t) now.tv_sec * 1000000 + (uint64_t) now.tv_nsec / 1000;
+}
+
 void nxai_initialise_logging( const char *start_log_filepath, const char *rotating_log_filepath, const char *log_prefix, bool log_to_console ) {
     _start_log_filepath = strdup( start_log_filepath );
     _rotating_log_filepath = strdup( rotating_log_filepath );
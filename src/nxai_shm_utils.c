@@ -1,9 +1,15 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "nxai_shm_utils.h"
 
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,10 +33,173 @@
 // SHM stuff
 #include <fcntl.h>
 #include <sys/select.h>
+#include <sys/mman.h>
 #include <sys/shm.h>
 #include <sys/stat.h>
 
-#define HEADER_BYTES 4
+// Ring buffer signalling
+#include <linux/futex.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+
+// Streaming copies
+#if defined( __x86_64__ )
+#include <immintrin.h>
+#elif defined( __aarch64__ ) && defined( __ARM_NEON )
+#include <arm_neon.h>
+#endif
+
+// Segments start with a versioned header, the payload starts at a 64-byte aligned offset after it.
+// Old segments start with the 32-bit payload size, the payload follows at offset 4. The sentinel can
+// not be an old size, so readers tell the formats apart by the first 4 bytes.
+#define HEADER_BYTES NXAI_SHM_HEADER_BYTES
+#define HEADER_SENTINEL UINT32_MAX
+#define HEADER_MAGIC 0x3253584E// "NXS2"
+#define LEGACY_HEADER_BYTES 4
+
+/**
+ * @brief Versioned header at the start of a segment, written by every writer.
+ */
+typedef struct {
+    uint32_t sentinel;
+    uint32_t magic;
+    uint64_t data_length;
+    uint32_t payload_offset;
+    // `NXAI_SHM_SEQLOCK_CHECKSUM` if the checksum is set
+    uint16_t flags;
+    // Set once next_shm_id is valid
+    uint16_t forwarded;
+    // Advanced every time the data moves to a larger segment with `nxai_shm_realloc`
+    uint32_t generation;
+    // The segment that replaced this one
+    int32_t next_shm_id;
+    // Odd while a write is in progress, advanced by two for every write
+    uint64_t sequence;
+    // Bytes of data the segment holds, 0 if the writer did not know
+    uint64_t capacity;
+    uint64_t timestamp_us;
+    uint64_t checksum;
+} _shm_header_t;
+
+_Static_assert( sizeof( _shm_header_t ) == HEADER_BYTES, "SHM header does not fill its space" );
+
+// Descriptor backed segments with huge pages use 2 MB pages, their size is a multiple of it
+#define SHM_HUGE_PAGE_SIZE ( 2 * 1024 * 1024 )
+#ifndef MFD_HUGE_2MB
+#define MFD_HUGE_2MB ( 21U << 26 )
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+// Highest NUMA node a segment can be placed on, plus one
+#define SHM_MAX_NUMA_NODES 1024
+
+// Payloads from this size on are copied with non-temporal stores. Only the reader uses them, copying them
+// through the cache would evict the writer's own data.
+#define STREAMING_COPY_DEFAULT_THRESHOLD ( 4 * 1024 * 1024 )
+// Streaming copies align the destination first, smaller copies are not worth it
+#define STREAMING_COPY_MINIMUM_THRESHOLD 256
+
+static size_t _streaming_copy_threshold = STREAMING_COPY_DEFAULT_THRESHOLD;
+
+// Readers retry a torn snapshot this many times before giving up, a writer may have died halfway
+#define SEQLOCK_READ_ATTEMPTS 1000
+
+// Segment attached by `nxai_shm_write` or `nxai_shm_read`, which stays attached for the next call
+typedef struct {
+    int shm_id;
+    void *address;
+    // Reads that have not been closed yet
+    size_t references;
+    // Set when the segment should be detached as soon as it is no longer referenced
+    bool evicted;
+    // The segment that replaced this one, -1 if it was not replaced. Replaced segments are detached once
+    // they are no longer referenced, the entry stays to send later reads to the new segment.
+    int next_shm_id;
+    // Size of the segment, including the header
+    size_t size;
+    uint64_t last_used;
+} _shm_attachment_t;
+
+// Segments kept at most, the least recently used unreferenced segment makes room for a new one
+#define SHM_CACHE_ENTRIES 64
+
+static pthread_mutex_t _attachments_lock = PTHREAD_MUTEX_INITIALIZER;
+static _shm_attachment_t *_attachments = NULL;
+static size_t _num_attachments = 0;
+static size_t _allocated_attachments = 0;
+static uint64_t _attachments_clock = 0;
+
+// Descriptor backed segment mapped by `nxai_shm_fd_write`, which stays mapped for the next write
+typedef struct {
+    // The segment, descriptor numbers are reused so it is identified by its inode
+    dev_t device;
+    ino_t inode;
+    void *address;
+    // Size of the mapping, including the header
+    size_t size;
+    // Writes in progress
+    size_t references;
+    // Set when the segment should be unmapped as soon as it is no longer referenced
+    bool evicted;
+    uint64_t last_used;
+} _shm_fd_mapping_t;
+
+// Mappings kept at most, the least recently written unreferenced mapping makes room for a new one
+#define SHM_FD_CACHE_ENTRIES 16
+
+static pthread_mutex_t _fd_mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+static _shm_fd_mapping_t _fd_mappings[SHM_FD_CACHE_ENTRIES];
+static size_t _num_fd_mappings = 0;
+static uint64_t _fd_mappings_clock = 0;
+
+// Keys of segments created by a process hold its process id above a counter of this many bits, process ids
+// fit in the remaining 22 bits, so processes never try the same keys
+#define SHM_KEY_COUNTER_BITS 10
+
+static uint32_t _shm_key_counter = 0;
+
+// A process with all its keys in use probes this many keys spread over the whole key space
+#define SHM_KEY_PROBE_ATTEMPTS 4096
+
+static uint32_t _shm_key_probe_counter = 0;
+
+/**
+ * @brief Segment created ahead of time with `nxai_shm_preallocate`, handed out by `nxai_shm_create_random`.
+ */
+typedef struct {
+    key_t shm_key;
+    int shm_id;
+    size_t size;
+} _shm_preallocated_t;
+
+static pthread_mutex_t _preallocated_lock = PTHREAD_MUTEX_INITIALIZER;
+static _shm_preallocated_t *_preallocated = NULL;
+static size_t _num_preallocated = 0;
+
+// Ring buffer layout, records are aligned to 8 bytes and start with an 8-byte header holding the length
+#define RING_MAGIC 0x474E5258// "XRNG"
+#define RING_RECORD_HEADER_BYTES 8
+#define RING_RECORD_ALIGNMENT 8
+// Record length marking the unused end of the ring, the next record starts at the beginning
+#define RING_PADDING_RECORD UINT32_MAX
+// Record length of a message whose producer gave up publishing it, the real length follows the marker
+#define RING_ABANDONED_RECORD ( UINT32_MAX - 1 )
+// Spins waiting for an earlier producer to publish before yielding the processor
+#define RING_PUBLISH_SPINS 1024
+// Claims that gave up publishing and wait for the earlier claims to be published for them
+#define RING_MAX_ABANDONED 16
+
+// Frame pool layout, slot states and frame data are aligned to cache lines
+#define FRAME_POOL_MAGIC 0x4C505846// "FXPL"
+#define FRAME_POOL_ALIGNMENT 64
+// Slot states, a slot moves from free to writing to ready to reading and back to free
+#define FRAME_SLOT_FREE 0
+#define FRAME_SLOT_WRITING 1
+#define FRAME_SLOT_READY 2
+#define FRAME_SLOT_READING 3
 
 bool nxai_create_pipe( int pipefd[2] ) {
     int result = pipe( pipefd );
@@ -84,27 +253,251 @@ void nxai_pipe_close( int fd ) {
     }
 }
 
+/**
+ * @brief Puts the header of the current format at the start of a segment, if it is not there yet.
+ *
+ * @param capacity The bytes of data the segment holds, or 0 to keep what the header says.
+ */
+static _shm_header_t *_shm_prepare_header( void *shm_buffer, size_t capacity ) {
+    _shm_header_t *header = shm_buffer;
+    if ( header->sentinel != HEADER_SENTINEL || header->magic != HEADER_MAGIC ) {
+        // Written in the old format or not at all, readers see it as the old format until the magic is set
+        _shm_header_t new_header = { .sentinel = 0, .magic = HEADER_MAGIC, .payload_offset = HEADER_BYTES, .next_shm_id = -1 };
+        memcpy( header, &new_header, sizeof( new_header ) );
+        __atomic_store_n( &header->sentinel, HEADER_SENTINEL, __ATOMIC_RELEASE );
+    }
+    if ( capacity > 0 ) {
+        header->capacity = capacity;
+    }
+    return header;
+}
+
+/**
+ * @brief Writes the header of the current format to a new segment, so it is not taken for the old format.
+ */
+static void _shm_init_header( int shm_id, size_t size ) {
+    void *address = shmat( shm_id, NULL, 0 );
+    if ( address == (void *) -1 ) {
+        printf( "Warning: Could not attach new SHM to write its header: %s\n", strerror( errno ) );
+        return;
+    }
+    _shm_prepare_header( address, size );
+    shmdt( address );
+}
+
+/**
+ * @brief Gets the segment of a key, creating it if it does not exist yet.
+ *
+ * @param created Set to whether the segment was created, segments that existed keep their data.
+ * @return The identifier of the segment, -1 with errno set if it could not be created.
+ */
+static int _shm_get_or_create( key_t shm_key, size_t segment_size, int shm_flags, bool *created ) {
+    int shm_id = shmget( shm_key, segment_size, 0666 | IPC_CREAT | IPC_EXCL | shm_flags );
+    *created = shm_id != -1;
+    if ( shm_id == -1 && errno == EEXIST ) {
+        shm_id = shmget( shm_key, segment_size, 0666 | IPC_CREAT | shm_flags );
+    }
+    return shm_id;
+}
+
+/**
+ * @brief Creates a segment under the next key of this process.
+ *
+ * A key is only taken when a segment of an earlier process with the same id is left behind. When all
+ * keys of this process are in use, other keys are probed until a free one is found.
+ *
+ * @return The key, with `shm_id` set to -1 and errno set if the segment could not be created.
+ */
+static key_t _shm_create_unique( size_t segment_size, int shm_flags, int *shm_id ) {
+    uint32_t process_bits = (uint32_t) getpid() << SHM_KEY_COUNTER_BITS;
+    for ( uint32_t attempt = 0; attempt < ( 1U << SHM_KEY_COUNTER_BITS ); attempt++ ) {
+        uint32_t counter = __atomic_fetch_add( &_shm_key_counter, 1, __ATOMIC_RELAXED ) & ( ( 1U << SHM_KEY_COUNTER_BITS ) - 1 );
+        key_t shm_key = (key_t) ( process_bits | counter );
+        *shm_id = shmget( shm_key, segment_size, 0666 | IPC_CREAT | IPC_EXCL | shm_flags );
+        if ( *shm_id != -1 || errno != EEXIST ) {
+            return shm_key;
+        }
+    }
+    for ( uint32_t attempt = 0; attempt < SHM_KEY_PROBE_ATTEMPTS; attempt++ ) {
+        // Multiplying by an odd number visits every key once before repeating
+        uint32_t probe = __atomic_fetch_add( &_shm_key_probe_counter, 1, __ATOMIC_RELAXED );
+        key_t shm_key = (key_t) ( process_bits ^ ( probe * 2654435761U ) );
+        if ( shm_key == IPC_PRIVATE ) {
+            continue;
+        }
+        *shm_id = shmget( shm_key, segment_size, 0666 | IPC_CREAT | IPC_EXCL | shm_flags );
+        if ( *shm_id != -1 || errno != EEXIST ) {
+            return shm_key;
+        }
+    }
+    *shm_id = -1;
+    errno = ENOSPC;
+    return -1;
+}
+
 key_t nxai_shm_create_random( size_t size, int *shm_id ) {
-    int new_id = -1;
-    key_t shm_key;
-    // Keep trying random keys until unused is found
-    while ( new_id == -1 ) {
-        shm_key = rand();
-        new_id = shmget( shm_key, size + HEADER_BYTES, 0666 | IPC_CREAT | IPC_EXCL );
+    // Hand out the smallest preallocated segment the data fits in
+    pthread_mutex_lock( &_preallocated_lock );
+    size_t best = _num_preallocated;
+    for ( size_t index = 0; index < _num_preallocated; index++ ) {
+        if ( _preallocated[index].size >= size && ( best == _num_preallocated || _preallocated[index].size < _preallocated[best].size ) ) {
+            best = index;
+        }
     }
-    *shm_id = new_id;
+    if ( best < _num_preallocated ) {
+        key_t shm_key = _preallocated[best].shm_key;
+        *shm_id = _preallocated[best].shm_id;
+        _preallocated[best] = _preallocated[--_num_preallocated];
+        pthread_mutex_unlock( &_preallocated_lock );
+        return shm_key;
+    }
+    pthread_mutex_unlock( &_preallocated_lock );
+
+    key_t shm_key = _shm_create_unique( size + HEADER_BYTES, 0, shm_id );
+    if ( *shm_id == -1 ) {
+        printf( "Warning: Could not create SHM of %zu bytes: %s\n", size, strerror( errno ) );
+        return shm_key;
+    }
+    _shm_init_header( *shm_id, size );
     return shm_key;
 }
 
+bool nxai_shm_preallocate( size_t count, size_t size ) {
+    pthread_mutex_lock( &_preallocated_lock );
+    _shm_preallocated_t *new_pointer = realloc( _preallocated, ( _num_preallocated + count ) * sizeof( _shm_preallocated_t ) );
+    if ( new_pointer == NULL ) {
+        pthread_mutex_unlock( &_preallocated_lock );
+        return false;
+    }
+    _preallocated = new_pointer;
+    for ( size_t index = 0; index < count; index++ ) {
+        int shm_id;
+        key_t shm_key = _shm_create_unique( size + HEADER_BYTES, 0, &shm_id );
+        if ( shm_id == -1 ) {
+            printf( "Warning: Could not create SHM of %zu bytes: %s\n", size, strerror( errno ) );
+            // All or nothing, the segments of this call are not kept
+            while ( index > 0 ) {
+                index--;
+                shmctl( _preallocated[--_num_preallocated].shm_id, IPC_RMID, NULL );
+            }
+            pthread_mutex_unlock( &_preallocated_lock );
+            return false;
+        }
+        _shm_init_header( shm_id, size );
+        _preallocated[_num_preallocated++] = ( _shm_preallocated_t ) { .shm_key = shm_key, .shm_id = shm_id, .size = size };
+    }
+    pthread_mutex_unlock( &_preallocated_lock );
+    return true;
+}
+
+void nxai_shm_destroy_preallocated( void ) {
+    pthread_mutex_lock( &_preallocated_lock );
+    for ( size_t index = 0; index < _num_preallocated; index++ ) {
+        shmctl( _preallocated[index].shm_id, IPC_RMID, NULL );
+    }
+    free( _preallocated );
+    _preallocated = NULL;
+    _num_preallocated = 0;
+    pthread_mutex_unlock( &_preallocated_lock );
+}
+
 key_t nxai_shm_create( char *path, int project_id, size_t size, int *shm_id ) {
     key_t shm_key = ftok( path, project_id );
-    *shm_id = shmget( shm_key, size + HEADER_BYTES, 0666 | IPC_CREAT );
+    bool created;
+    *shm_id = _shm_get_or_create( shm_key, size + HEADER_BYTES, 0, &created );
     if ( *shm_id == -1 ) {
         perror( "Failed to create SHM:" );
+    } else if ( created ) {
+        _shm_init_header( *shm_id, size );
     }
     return shm_key;
 }
 
+/**
+ * @brief Places the pages of a new segment, before anything touches them.
+ *
+ * The NUMA policy set on a mapping of a segment applies to the segment itself, so later mappings in
+ * other processes get the same pages.
+ */
+static void _shm_place_pages( void *address, size_t segment_size, unsigned int flags, int numa_node ) {
+    if ( numa_node >= SHM_MAX_NUMA_NODES ) {
+        printf( "Warning: NUMA node %d is not supported for SHM, using any node\n", numa_node );
+    } else if ( numa_node >= 0 ) {
+        unsigned long node_mask[SHM_MAX_NUMA_NODES / ( 8 * sizeof( unsigned long ) )] = { 0 };
+        node_mask[numa_node / ( 8 * sizeof( unsigned long ) )] |= 1UL << ( numa_node % ( 8 * sizeof( unsigned long ) ) );
+        // Preferred rather than bound, so allocating falls back to other nodes when the node is full
+        if ( syscall( SYS_mbind, address, segment_size, MPOL_PREFERRED, node_mask, SHM_MAX_NUMA_NODES + 1, 0 ) == -1 ) {
+            printf( "Warning: Could not place SHM on NUMA node %d, using any node: %s\n", numa_node, strerror( errno ) );
+        }
+    }
+    if ( ( flags & NXAI_SHM_HUGE_PAGES ) && segment_size >= SHM_HUGE_PAGE_SIZE ) {
+        // Lets the kernel use transparent huge pages when it is configured to on request
+        madvise( address, segment_size, MADV_HUGEPAGE );
+    }
+    if ( flags & NXAI_SHM_PREFAULT ) {
+        nxai_shm_prefault( address, segment_size );
+    }
+}
+
+key_t nxai_shm_create_with_flags( char *path, int project_id, size_t size, unsigned int flags, int numa_node, int *shm_id ) {
+    size_t segment_size = size + HEADER_BYTES;
+    key_t shm_key = path != NULL ? ftok( path, project_id ) : IPC_PRIVATE;
+
+    *shm_id = -1;
+    // Segments created by an earlier call with the same key keep their data
+    bool created = true;
+    if ( flags & NXAI_SHM_HUGE_PAGES ) {
+        if ( path != NULL ) {
+            *shm_id = _shm_get_or_create( shm_key, segment_size, SHM_HUGETLB, &created );
+        } else {
+            shm_key = _shm_create_unique( segment_size, SHM_HUGETLB, shm_id );
+        }
+        if ( *shm_id == -1 ) {
+            printf( "Warning: Huge pages are not available for SHM, using normal pages: %s\n", strerror( errno ) );
+        } else {
+            // The mapping covers whole huge pages, and can only be placed as a whole
+            segment_size = ( segment_size + SHM_HUGE_PAGE_SIZE - 1 ) & ~( (size_t) SHM_HUGE_PAGE_SIZE - 1 );
+        }
+    }
+    if ( *shm_id == -1 ) {
+        if ( path != NULL ) {
+            *shm_id = _shm_get_or_create( shm_key, segment_size, 0, &created );
+        } else {
+            shm_key = _shm_create_unique( segment_size, 0, shm_id );
+        }
+    }
+    if ( *shm_id == -1 ) {
+        printf( "Warning: Could not create SHM of %zu bytes: %s\n", size, strerror( errno ) );
+        return shm_key;
+    }
+
+    if ( created || ( flags & ( NXAI_SHM_HUGE_PAGES | NXAI_SHM_PREFAULT ) ) || numa_node >= 0 ) {
+        void *address = shmat( *shm_id, NULL, 0 );
+        if ( address == (void *) -1 ) {
+            printf( "Warning: Could not attach SHM to prepare it: %s\n", strerror( errno ) );
+            return shm_key;
+        }
+        // Placed before the header touches the first page
+        _shm_place_pages( address, segment_size, flags, numa_node );
+        if ( created ) {
+            _shm_prepare_header( address, size );
+        }
+        shmdt( address );
+    }
+    return shm_key;
+}
+
+void nxai_shm_prefault( void *shm_pointer, size_t size ) {
+    if ( madvise( shm_pointer, size, MADV_POPULATE_WRITE ) == 0 ) {
+        return;
+    }
+    // Older kernels, reading a page of shared memory allocates and maps it as well
+    long page_size = sysconf( _SC_PAGESIZE );
+    for ( size_t offset = 0; offset < size; offset += (size_t) page_size ) {
+        (void) *(volatile const char *) ( (const char *) shm_pointer + offset );
+    }
+}
+
 int nxai_shm_get( key_t shm_key ) {
     int shm_id = shmget( shm_key, 0, 0 );
     if ( shm_id == -1 ) {
@@ -113,6 +506,195 @@ int nxai_shm_get( key_t shm_key ) {
     return shm_id;
 }
 
+/**
+ * @brief Detaches a cached segment and removes it from the cache. Called with the cache locked.
+ */
+static void _shm_cache_remove( size_t index ) {
+    if ( _attachments[index].address != NULL ) {
+        shmdt( _attachments[index].address );
+    }
+    _attachments[index] = _attachments[--_num_attachments];
+}
+
+/**
+ * @brief Makes room for a new entry, and grows the cache when every entry is referenced. Called with the
+ * cache locked.
+ *
+ * @return false if there is no room.
+ */
+static bool _shm_cache_make_room( void ) {
+    if ( _num_attachments >= SHM_CACHE_ENTRIES ) {
+        size_t oldest = _num_attachments;
+        for ( size_t index = 0; index < _num_attachments; index++ ) {
+            if ( _attachments[index].references == 0 && ( oldest == _num_attachments || _attachments[index].last_used < _attachments[oldest].last_used ) ) {
+                oldest = index;
+            }
+        }
+        if ( oldest < _num_attachments ) {
+            _shm_cache_remove( oldest );
+        }
+    }
+    if ( _num_attachments == _allocated_attachments ) {
+        size_t new_allocated = _allocated_attachments > 0 ? 2 * _allocated_attachments : 8;
+        _shm_attachment_t *new_pointer = realloc( _attachments, new_allocated * sizeof( _shm_attachment_t ) );
+        if ( new_pointer == NULL ) {
+            return false;
+        }
+        _attachments = new_pointer;
+        _allocated_attachments = new_allocated;
+    }
+    return true;
+}
+
+/**
+ * @brief Gets the segment that replaced an attached segment.
+ *
+ * @return The identifier of the new segment, -1 if the segment was not replaced.
+ */
+static int _shm_get_next_id( const void *shm_pointer ) {
+    const _shm_header_t *header = shm_pointer;
+    if ( header->sentinel != HEADER_SENTINEL || header->magic != HEADER_MAGIC ||
+         __atomic_load_n( &header->forwarded, __ATOMIC_ACQUIRE ) == 0 ) {
+        return -1;
+    }
+    return header->next_shm_id;
+}
+
+/**
+ * @brief Gets the cached attachment of a segment, attaching it if it is not cached yet.
+ *
+ * Segments that were replaced by `nxai_shm_realloc` are followed to the segment that replaced them.
+ *
+ * @return The address of the segment, or (void *) -1 if it could not be attached.
+ */
+static void *_shm_cache_acquire( int shm_id ) {
+    pthread_mutex_lock( &_attachments_lock );
+    size_t index = 0;
+    while ( index < _num_attachments ) {
+        if ( _attachments[index].shm_id != shm_id || _attachments[index].evicted == true ) {
+            index++;
+            continue;
+        }
+        if ( _attachments[index].next_shm_id == -1 && _attachments[index].address != NULL ) {
+            _attachments[index].next_shm_id = _shm_get_next_id( _attachments[index].address );
+        }
+        _attachments[index].last_used = ++_attachments_clock;
+        if ( _attachments[index].next_shm_id == -1 ) {
+            _attachments[index].references++;
+            void *address = _attachments[index].address;
+            pthread_mutex_unlock( &_attachments_lock );
+            return address;
+        }
+        // Replaced, the old data is no longer needed once it is no longer referenced
+        if ( _attachments[index].references == 0 && _attachments[index].address != NULL ) {
+            shmdt( _attachments[index].address );
+            _attachments[index].address = NULL;
+        }
+        shm_id = _attachments[index].next_shm_id;
+        index = 0;
+    }
+
+    if ( _shm_cache_make_room() == false ) {
+        pthread_mutex_unlock( &_attachments_lock );
+        return (void *) -1;
+    }
+    void *address = shmat( shm_id, NULL, 0 );
+    if ( address == (void *) -1 ) {
+        pthread_mutex_unlock( &_attachments_lock );
+        return address;
+    }
+    struct shmid_ds status;
+    size_t size = shmctl( shm_id, IPC_STAT, &status ) == 0 ? status.shm_segsz : 0;
+    _attachments[_num_attachments++] = ( _shm_attachment_t ) { .shm_id = shm_id, .address = address, .references = 0, .evicted = false, .next_shm_id = -1, .size = size, .last_used = ++_attachments_clock };
+    pthread_mutex_unlock( &_attachments_lock );
+    // The new entry is found now, and followed if the segment was replaced already
+    return _shm_cache_acquire( shm_id );
+}
+
+/**
+ * @brief Releases a reference to a cached segment.
+ *
+ * @return false if the address is not a cached segment.
+ */
+static bool _shm_cache_release( const void *address ) {
+    pthread_mutex_lock( &_attachments_lock );
+    for ( size_t index = 0; index < _num_attachments; index++ ) {
+        if ( _attachments[index].address == address && _attachments[index].references > 0 ) {
+            _attachments[index].references--;
+            if ( _attachments[index].references > 0 ) {
+                pthread_mutex_unlock( &_attachments_lock );
+                return true;
+            }
+            if ( _attachments[index].next_shm_id == -1 ) {
+                _attachments[index].next_shm_id = _shm_get_next_id( _attachments[index].address );
+            }
+            struct shmid_ds status;
+            if ( _attachments[index].evicted == true ) {
+                _shm_cache_remove( index );
+            } else if ( _attachments[index].next_shm_id != -1 ) {
+                shmdt( _attachments[index].address );
+                _attachments[index].address = NULL;
+            } else if ( shmctl( _attachments[index].shm_id, IPC_STAT, &status ) != 0 || ( status.shm_perm.mode & SHM_DEST ) ) {
+                // Destroyed by another process, it is only freed once no process has it attached
+                _shm_cache_remove( index );
+            }
+            pthread_mutex_unlock( &_attachments_lock );
+            return true;
+        }
+    }
+    pthread_mutex_unlock( &_attachments_lock );
+    return false;
+}
+
+/**
+ * @brief Gets the size of a referenced cached segment, including the header.
+ *
+ * @return 0 if the address is not a referenced cached segment.
+ */
+static size_t _shm_cache_get_size( const void *address ) {
+    size_t size = 0;
+    pthread_mutex_lock( &_attachments_lock );
+    for ( size_t index = 0; index < _num_attachments; index++ ) {
+        if ( _attachments[index].address == address && _attachments[index].references > 0 ) {
+            size = _attachments[index].size;
+            break;
+        }
+    }
+    pthread_mutex_unlock( &_attachments_lock );
+    return size;
+}
+
+void nxai_shm_cache_evict( int shm_id ) {
+    pthread_mutex_lock( &_attachments_lock );
+    size_t index = 0;
+    while ( index < _num_attachments ) {
+        if ( _attachments[index].shm_id == shm_id ) {
+            _attachments[index].evicted = true;
+            if ( _attachments[index].references == 0 ) {
+                // The last entry moved to this index, check it next
+                _shm_cache_remove( index );
+                continue;
+            }
+        }
+        index++;
+    }
+    pthread_mutex_unlock( &_attachments_lock );
+}
+
+void nxai_shm_cache_clear( void ) {
+    pthread_mutex_lock( &_attachments_lock );
+    size_t index = 0;
+    while ( index < _num_attachments ) {
+        _attachments[index].evicted = true;
+        if ( _attachments[index].references == 0 ) {
+            _shm_cache_remove( index );
+            continue;
+        }
+        index++;
+    }
+    pthread_mutex_unlock( &_attachments_lock );
+}
+
 void *nxai_shm_attach( int shm_id ) {
     // Attach the shared memory segment to the process's address space.
     // This is done by calling the shmat() function with the shared memory ID.
@@ -121,45 +703,269 @@ void *nxai_shm_attach( int shm_id ) {
     return result;
 }
 
-void nxai_shm_write_to_attached( void *shm_buffer, const char *data, uint32_t size ) {
-    // Write the size of the data to the beginning of the shared memory segment.
-    // This is done by copying the size (which is an integer) to the shared memory segment.
-    // The size is copied as a 4-byte value, as the size is represented as a 32-bit unsigned integer.
-    memcpy( shm_buffer, &size, HEADER_BYTES );
+#if defined( __x86_64__ )
+/**
+ * @brief Copies with 16-byte non-temporal stores, available on every x86-64 CPU.
+ */
+static void _shm_stream_copy_sse2( char *destination, const char *source, size_t size ) {
+    size_t head = ( 16 - ( (uintptr_t) destination & 15 ) ) & 15;
+    memcpy( destination, source, head );
+    destination += head;
+    source += head;
+    size -= head;
+    for ( ; size >= 64; size -= 64, destination += 64, source += 64 ) {
+        __m128i first = _mm_loadu_si128( (const __m128i *) source );
+        __m128i second = _mm_loadu_si128( (const __m128i *) ( source + 16 ) );
+        __m128i third = _mm_loadu_si128( (const __m128i *) ( source + 32 ) );
+        __m128i fourth = _mm_loadu_si128( (const __m128i *) ( source + 48 ) );
+        _mm_stream_si128( (__m128i *) destination, first );
+        _mm_stream_si128( (__m128i *) ( destination + 16 ), second );
+        _mm_stream_si128( (__m128i *) ( destination + 32 ), third );
+        _mm_stream_si128( (__m128i *) ( destination + 48 ), fourth );
+    }
+    // Non-temporal stores are not ordered with later stores, which may signal the reader
+    _mm_sfence();
+    memcpy( destination, source, size );
+}
+
+/**
+ * @brief Copies with 32-byte non-temporal stores.
+ */
+__attribute__( ( target( "avx2" ) ) ) static void _shm_stream_copy_avx2( char *destination, const char *source, size_t size ) {
+    size_t head = ( 32 - ( (uintptr_t) destination & 31 ) ) & 31;
+    memcpy( destination, source, head );
+    destination += head;
+    source += head;
+    size -= head;
+    for ( ; size >= 128; size -= 128, destination += 128, source += 128 ) {
+        __m256i first = _mm256_loadu_si256( (const __m256i *) source );
+        __m256i second = _mm256_loadu_si256( (const __m256i *) ( source + 32 ) );
+        __m256i third = _mm256_loadu_si256( (const __m256i *) ( source + 64 ) );
+        __m256i fourth = _mm256_loadu_si256( (const __m256i *) ( source + 96 ) );
+        _mm256_stream_si256( (__m256i *) destination, first );
+        _mm256_stream_si256( (__m256i *) ( destination + 32 ), second );
+        _mm256_stream_si256( (__m256i *) ( destination + 64 ), third );
+        _mm256_stream_si256( (__m256i *) ( destination + 96 ), fourth );
+    }
+    _mm_sfence();
+    memcpy( destination, source, size );
+}
+
+typedef void ( *_shm_stream_copy_t )( char *destination, const char *source, size_t size );
+
+// Chosen for the CPU on the first streaming copy
+static _shm_stream_copy_t _shm_stream_copy = NULL;
+#elif defined( __aarch64__ ) && defined( __ARM_NEON )
+/**
+ * @brief Copies with pairs of 16-byte non-temporal stores, available on every aarch64 CPU.
+ */
+static void _shm_stream_copy_neon( char *destination, const char *source, size_t size ) {
+    size_t head = ( 16 - ( (uintptr_t) destination & 15 ) ) & 15;
+    memcpy( destination, source, head );
+    destination += head;
+    source += head;
+    size -= head;
+    for ( ; size >= 64; size -= 64, destination += 64, source += 64 ) {
+        uint8x16_t first = vld1q_u8( (const uint8_t *) source );
+        uint8x16_t second = vld1q_u8( (const uint8_t *) ( source + 16 ) );
+        uint8x16_t third = vld1q_u8( (const uint8_t *) ( source + 32 ) );
+        uint8x16_t fourth = vld1q_u8( (const uint8_t *) ( source + 48 ) );
+        __asm__ volatile( "stnp %q1, %q2, [%0]\n\t"
+                          "stnp %q3, %q4, [%0, #32]"
+                          :
+                          : "r"( destination ), "w"( first ), "w"( second ), "w"( third ), "w"( fourth )
+                          : "memory" );
+    }
+    // Non-temporal stores may be observed after later stores, which may signal the reader
+    __asm__ volatile( "dmb ishst" ::: "memory" );
+    memcpy( destination, source, size );
+}
+#endif
+
+/**
+ * @brief Copies a payload into shared memory, large payloads bypass the cache.
+ */
+static void _shm_copy_payload( char *destination, const char *source, size_t size ) {
+    if ( size < __atomic_load_n( &_streaming_copy_threshold, __ATOMIC_RELAXED ) ) {
+        memcpy( destination, source, size );
+        return;
+    }
+#if defined( __x86_64__ )
+    _shm_stream_copy_t stream_copy = __atomic_load_n( &_shm_stream_copy, __ATOMIC_RELAXED );
+    if ( stream_copy == NULL ) {
+        __builtin_cpu_init();
+        stream_copy = __builtin_cpu_supports( "avx2" ) ? _shm_stream_copy_avx2 : _shm_stream_copy_sse2;
+        __atomic_store_n( &_shm_stream_copy, stream_copy, __ATOMIC_RELAXED );
+    }
+    stream_copy( destination, source, size );
+#elif defined( __aarch64__ ) && defined( __ARM_NEON )
+    _shm_stream_copy_neon( destination, source, size );
+#else
+    // Other architectures keep the C library copy
+    memcpy( destination, source, size );
+#endif
+}
+
+void nxai_shm_set_streaming_copy_threshold( size_t threshold ) {
+    if ( threshold < STREAMING_COPY_MINIMUM_THRESHOLD ) {
+        threshold = STREAMING_COPY_MINIMUM_THRESHOLD;
+    }
+    __atomic_store_n( &_streaming_copy_threshold, threshold, __ATOMIC_RELAXED );
+}
+
+/**
+ * @brief Hashes data eight bytes at a time, fast enough to run on every frame.
+ */
+static uint64_t _shm_checksum( const char *data, size_t length ) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ length;
+    size_t offset = 0;
+    for ( ; offset + sizeof( uint64_t ) <= length; offset += sizeof( uint64_t ) ) {
+        uint64_t word;
+        memcpy( &word, data + offset, sizeof( word ) );
+        hash = ( hash ^ word ) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+    for ( ; offset < length; offset++ ) {
+        hash = ( hash ^ (uint8_t) data[offset] ) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Replaces the data described by a header, so seqlock readers never use a torn copy.
+ *
+ * @param data The data to copy after the header, or NULL if it is in place already.
+ */
+static void _shm_write_payload( _shm_header_t *header, const char *data, size_t size, unsigned int flags ) {
+    struct timespec now;
+    clock_gettime( CLOCK_REALTIME, &now );
+
+    // Readers that see an odd sequence, or a different one after copying, retry. A writer that died
+    // halfway left it odd.
+    uint64_t sequence = __atomic_load_n( &header->sequence, __ATOMIC_RELAXED ) | 1;
+    __atomic_store_n( &header->sequence, sequence, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+
+    __atomic_store_n( &header->data_length, size, __ATOMIC_RELAXED );
+    __atomic_store_n( &header->timestamp_us, (uint64_t) now.tv_sec * 1000000 + (uint64_t) now.tv_nsec / 1000, __ATOMIC_RELAXED );
+    __atomic_store_n( &header->flags, (uint16_t) flags, __ATOMIC_RELAXED );
+    const char *payload = data != NULL ? data : (const char *) header + HEADER_BYTES;
+    __atomic_store_n( &header->checksum, ( flags & NXAI_SHM_SEQLOCK_CHECKSUM ) ? _shm_checksum( payload, size ) : 0, __ATOMIC_RELAXED );
+    if ( data != NULL ) {
+        // The payload is aligned to 64 bytes after the header, so it can be used with vector instructions in place
+        _shm_copy_payload( (char *) header + HEADER_BYTES, data, size );
+    }
 
-    // Write the data to the shared memory segment.
-    // This is done by copying the data to the shared memory segment, starting from the 4th byte,
-    // as the first 4 bytes are used to store the size of the data.
-    memcpy( shm_buffer + HEADER_BYTES, data, size );
+    __atomic_store_n( &header->sequence, sequence + 1, __ATOMIC_RELEASE );
 }
 
-bool nxai_shm_write( int shm_id, const char *data, uint32_t size ) {
+/**
+ * @brief Writes data to a segment of known size, in the layout it was created for.
+ *
+ * Segments created by older versions only have room for a 4-byte header, data that only fits that way
+ * is written in the old format, which older readers expect as well. Segments that hold the current
+ * header were created for it, and keep it.
+ *
+ * @return false if the data does not fit.
+ */
+static bool _shm_write_to_segment( void *shm_buffer, size_t segment_size, const char *data, size_t size ) {
+    if ( segment_size < HEADER_BYTES || size > segment_size - HEADER_BYTES ) {
+        const _shm_header_t *header = shm_buffer;
+        bool current = segment_size >= HEADER_BYTES && header->sentinel == HEADER_SENTINEL && header->magic == HEADER_MAGIC;
+        if ( current || segment_size < LEGACY_HEADER_BYTES || size > segment_size - LEGACY_HEADER_BYTES || size >= HEADER_SENTINEL ) {
+            printf( "Warning: Data of %zu bytes does not fit in SHM of %zu bytes\n", size, segment_size );
+            return false;
+        }
+        uint32_t legacy_size = (uint32_t) size;
+        memcpy( shm_buffer, &legacy_size, LEGACY_HEADER_BYTES );
+        _shm_copy_payload( (char *) shm_buffer + LEGACY_HEADER_BYTES, data, size );
+        return true;
+    }
+    _shm_write_payload( _shm_prepare_header( shm_buffer, segment_size - HEADER_BYTES ), data, size, 0 );
+    return true;
+}
+
+void nxai_shm_commit_to_attached( void *shm_buffer, size_t size ) {
+    // The data is in place already, only the header changes
+    _shm_write_payload( _shm_prepare_header( shm_buffer, 0 ), NULL, size, 0 );
+}
+
+void nxai_shm_write_to_attached( void *shm_buffer, const char *data, size_t size ) {
+    // Segments written before know how much they hold
+    _shm_header_t *header = _shm_prepare_header( shm_buffer, 0 );
+    if ( header->capacity > 0 && size > header->capacity ) {
+        printf( "Warning: Data of %zu bytes does not fit in SHM of %lu bytes\n", size, (unsigned long) header->capacity );
+        return;
+    }
+    _shm_write_payload( header, data, size, 0 );
+}
+
+bool nxai_shm_write( int shm_id, const char *data, size_t size ) {
 
-    void *result = nxai_shm_attach( shm_id );
+    // Attaching is expensive, the segment stays attached for the next write
+    void *result = _shm_cache_acquire( shm_id );
     if ( result == (void *) -1 ) {
         return false;
     }
 
-    nxai_shm_write_to_attached( result, data, size );
+    bool written = _shm_write_to_segment( result, _shm_cache_get_size( result ), data, size );
 
-    // Detach the shared memory segment from the process's address space.
-    // This is done by calling the shmdt() function with the pointer to the shared memory segment.
-    shmdt( result );
+    _shm_cache_release( result );
 
-    return true;
+    return written;
+}
+
+char *nxai_shm_reserve( int shm_id, size_t *capacity ) {
+    // The segment stays referenced until the data is committed
+    void *result = _shm_cache_acquire( shm_id );
+    if ( result == (void *) -1 ) {
+        printf( "Warning: Could not attach SHM %d: %s\n", shm_id, strerror( errno ) );
+        return NULL;
+    }
+    size_t segment_size = _shm_cache_get_size( result );
+    *capacity = segment_size > HEADER_BYTES ? segment_size - HEADER_BYTES : 0;
+    return (char *) result + HEADER_BYTES;
+}
+
+bool nxai_shm_commit( char *payload, size_t size ) {
+    void *shm_buffer = payload - HEADER_BYTES;
+    size_t segment_size = _shm_cache_get_size( shm_buffer );
+    if ( segment_size == 0 ) {
+        printf( "Warning: Committed SHM data was not reserved\n" );
+        return false;
+    }
+    bool fits = segment_size >= HEADER_BYTES && size <= segment_size - HEADER_BYTES;
+    if ( fits ) {
+        _shm_write_payload( _shm_prepare_header( shm_buffer, segment_size - HEADER_BYTES ), NULL, size, 0 );
+    } else {
+        printf( "Warning: Data of %zu bytes does not fit in SHM of %zu bytes\n", size, segment_size - HEADER_BYTES );
+    }
+    _shm_cache_release( shm_buffer );
+    return fits;
+}
+
+void nxai_shm_cancel( char *payload ) {
+    _shm_cache_release( payload - HEADER_BYTES );
 }
 
 void nxai_shm_read_from_attached( void *shm_pointer, size_t *data_length, char **payload_data ) {
-    // The first 4 bytes of the shared memory is always the size of the tensor
+    _shm_header_t header;
+    memcpy( &header, shm_pointer, sizeof( header ) );
+    if ( header.sentinel == HEADER_SENTINEL && header.magic == HEADER_MAGIC ) {
+        *data_length = (size_t) header.data_length;
+        *payload_data = (char *) shm_pointer + header.payload_offset;
+        return;
+    }
+    // Old format, the first 4 bytes of the shared memory are the size of the tensor
     uint32_t size;
-    memcpy( &size, shm_pointer, HEADER_BYTES );
+    memcpy( &size, shm_pointer, LEGACY_HEADER_BYTES );
     *data_length = (size_t) size;
     // Return pointer to the payload data after the size header
-    *payload_data = (char *) shm_pointer + HEADER_BYTES;
+    *payload_data = (char *) shm_pointer + LEGACY_HEADER_BYTES;
 }
 
 void *nxai_shm_read( int shm_id, size_t *data_length, char **payload_data ) {
-    void *shm_pointer = shmat( shm_id, NULL, 0 );
+    void *shm_pointer = _shm_cache_acquire( shm_id );
     if ( shm_pointer == (void *) -1 ) {
         return NULL;
     }
@@ -169,28 +975,1096 @@ void *nxai_shm_read( int shm_id, size_t *data_length, char **payload_data ) {
 }
 
 void nxai_shm_close( void *memory_address ) {
-    // Detach memory from this process
-    shmdt( memory_address );
+    // Cached segments stay attached, detach other memory from this process
+    if ( _shm_cache_release( memory_address ) == false ) {
+        shmdt( memory_address );
+    }
 }
 
 int nxai_shm_destroy( int shm_id ) {
-    return shmctl( shm_id, IPC_RMID, NULL );
+    int result = shmctl( shm_id, IPC_RMID, NULL );
+    // A removed segment lives on while it is attached, so it must leave the cache
+    nxai_shm_cache_evict( shm_id );
+    return result;
+}
+
+/**
+ * @brief Sends later reads and writes of a replaced segment in this process to the segment that replaced it.
+ *
+ * Segments in the old format can not point to the new segment themselves, so the cache entry does.
+ */
+static void _shm_cache_forward( int old_shm_id, int new_shm_id ) {
+    pthread_mutex_lock( &_attachments_lock );
+    bool found = false;
+    for ( size_t index = 0; index < _num_attachments; index++ ) {
+        if ( _attachments[index].shm_id != old_shm_id || _attachments[index].evicted == true ) {
+            continue;
+        }
+        _attachments[index].next_shm_id = new_shm_id;
+        if ( _attachments[index].references == 0 && _attachments[index].address != NULL ) {
+            shmdt( _attachments[index].address );
+            _attachments[index].address = NULL;
+        }
+        found = true;
+    }
+    if ( found == false && _shm_cache_make_room() ) {
+        _attachments[_num_attachments++] = ( _shm_attachment_t ) { .shm_id = old_shm_id, .address = NULL, .references = 0, .evicted = false, .next_shm_id = new_shm_id, .size = 0, .last_used = ++_attachments_clock };
+    }
+    pthread_mutex_unlock( &_attachments_lock );
 }
 
 int nxai_shm_realloc( key_t shm_key, int old_shm_id, size_t new_size ) {
 
-    // Remove old SHM
-    if ( nxai_shm_destroy( old_shm_id ) != 0 ) {
+    // The old segment stays attached until its data is copied and readers are sent to the new segment
+    struct shmid_ds old_stat;
+    void *old_pointer = shmat( old_shm_id, NULL, 0 );
+    if ( old_pointer == (void *) -1 || shmctl( old_shm_id, IPC_STAT, &old_stat ) != 0 ) {
+        printf( "Warning: Could not attach SHM %d for resizing: %s\n", old_shm_id, strerror( errno ) );
+        if ( old_pointer != (void *) -1 ) {
+            shmdt( old_pointer );
+        }
+        return -1;
+    }
+
+    // Remove old SHM, this frees the key for the new segment. It stays in the cache, so the old
+    // identifier can be forwarded to the new segment.
+    if ( shmctl( old_shm_id, IPC_RMID, NULL ) != 0 ) {
+        shmdt( old_pointer );
         return -1;
     }
 
     int new_shm_id = shmget( shm_key, new_size + HEADER_BYTES, 0666 | IPC_CREAT );
+    if ( new_shm_id == -1 ) {
+        shmdt( old_pointer );
+        nxai_shm_cache_evict( old_shm_id );
+        return -1;
+    }
+    _shm_cache_forward( old_shm_id, new_shm_id );
+    void *new_pointer = shmat( new_shm_id, NULL, 0 );
+    if ( new_pointer == (void *) -1 ) {
+        printf( "Warning: Could not attach SHM %d for resizing: %s\n", new_shm_id, strerror( errno ) );
+        shmdt( old_pointer );
+        return new_shm_id;
+    }
+
+    _shm_header_t *old_header = old_pointer;
+    if ( old_header->sentinel != HEADER_SENTINEL || old_header->magic != HEADER_MAGIC ) {
+        // Old format, the data moves to the new segment in the current format
+        uint32_t legacy_size = 0;
+        memcpy( &legacy_size, old_pointer, old_stat.shm_segsz < LEGACY_HEADER_BYTES ? old_stat.shm_segsz : LEGACY_HEADER_BYTES );
+        size_t data_length = old_stat.shm_segsz > LEGACY_HEADER_BYTES ? old_stat.shm_segsz - LEGACY_HEADER_BYTES : 0;
+        data_length = legacy_size < data_length ? legacy_size : data_length;
+        data_length = new_size < data_length ? new_size : data_length;
+        memcpy( (char *) new_pointer + HEADER_BYTES, (const char *) old_pointer + LEGACY_HEADER_BYTES, data_length );
+        _shm_prepare_header( new_pointer, new_size )->data_length = data_length;
+    } else {
+        // Copy everything that fits
+        size_t new_segment_size = new_size + HEADER_BYTES;
+        memcpy( new_pointer, old_pointer, old_stat.shm_segsz < new_segment_size ? old_stat.shm_segsz : new_segment_size );
+        _shm_header_t *new_header = new_pointer;
+        new_header->generation = old_header->generation + 1;
+        new_header->capacity = new_size;
+        new_header->next_shm_id = -1;
+        new_header->forwarded = 0;
+        if ( new_header->data_length > new_size ) {
+            new_header->data_length = new_size;
+        }
+        // Readers that still have the old segment attached move to the new one on their next read
+        old_header->next_shm_id = new_shm_id;
+        __atomic_store_n( &old_header->forwarded, 1, __ATOMIC_RELEASE );
+    }
 
+    shmdt( new_pointer );
+    shmdt( old_pointer );
     return new_shm_id;
 }
 
+int nxai_shm_get_next_id( const void *shm_pointer ) {
+    return _shm_get_next_id( shm_pointer );
+}
+
+uint64_t nxai_shm_get_generation( const void *shm_pointer ) {
+    const _shm_header_t *header = shm_pointer;
+    if ( header->sentinel != HEADER_SENTINEL || header->magic != HEADER_MAGIC ) {
+        return 0;
+    }
+    return header->generation;
+}
+
 size_t nxai_shm_get_size( int shm_id ) {
     struct shmid_ds buf;
-    shmctl( shm_id, IPC_STAT, &buf );
-    return buf.shm_segsz - HEADER_BYTES;
-}
\ No newline at end of file
+    if ( shmctl( shm_id, IPC_STAT, &buf ) != 0 ) {
+        return 0;
+    }
+    if ( buf.shm_segsz < HEADER_BYTES ) {
+        return buf.shm_segsz > LEGACY_HEADER_BYTES ? buf.shm_segsz - LEGACY_HEADER_BYTES : 0;
+    }
+    // Segments created by this library start with the current header, others were created for the old
+    // format, data that only fits in that is written in it
+    bool current = false;
+    void *shm_pointer = _shm_cache_acquire( shm_id );
+    if ( shm_pointer != (void *) -1 ) {
+        const _shm_header_t *header = shm_pointer;
+        current = header->sentinel == HEADER_SENTINEL && header->magic == HEADER_MAGIC;
+        _shm_cache_release( shm_pointer );
+    }
+    return buf.shm_segsz - ( current ? HEADER_BYTES : LEGACY_HEADER_BYTES );
+}
+
+bool nxai_shm_seqlock_init( void *shm_buffer, size_t size ) {
+    // Seqlock segments use the normal header, which has to know the capacity to bound torn reads
+    if ( size == 0 ) {
+        printf( "Warning: SHM without room for data can not be used with a seqlock\n" );
+        return false;
+    }
+    _shm_prepare_header( shm_buffer, size );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    return true;
+}
+
+bool nxai_shm_seqlock_write( void *shm_buffer, const char *data, size_t size, unsigned int flags ) {
+    _shm_header_t *header = _shm_prepare_header( shm_buffer, 0 );
+    if ( header->capacity > 0 && size > header->capacity ) {
+        printf( "Warning: Data of %zu bytes does not fit in SHM of %lu bytes\n", size, (unsigned long) header->capacity );
+        return false;
+    }
+    _shm_write_payload( header, data, size, flags );
+    return true;
+}
+
+uint64_t nxai_shm_seqlock_get_sequence( const void *shm_buffer ) {
+    const _shm_header_t *header = shm_buffer;
+    return __atomic_load_n( &header->sequence, __ATOMIC_ACQUIRE );
+}
+
+bool nxai_shm_seqlock_read( const void *shm_buffer, size_t *allocated_buffer_size, char **data_buffer, size_t *data_length, uint64_t *sequence, uint64_t *timestamp_us ) {
+    const _shm_header_t *header = shm_buffer;
+    const char *data = (const char *) shm_buffer + HEADER_BYTES;
+    *data_length = 0;
+    if ( __atomic_load_n( &header->sentinel, __ATOMIC_ACQUIRE ) != HEADER_SENTINEL || header->magic != HEADER_MAGIC ) {
+        printf( "Warning: SHM was not written in the current format.\n" );
+        return false;
+    }
+
+    for ( uint32_t attempt = 0; attempt < SEQLOCK_READ_ATTEMPTS; attempt++ ) {
+        uint64_t sequence_before = __atomic_load_n( &header->sequence, __ATOMIC_ACQUIRE );
+        if ( sequence_before & 1 ) {
+            // Write in progress
+            sched_yield();
+            continue;
+        }
+        // A torn length is only used to size the copy, bound it so the copy stays in the segment
+        uint64_t length = __atomic_load_n( &header->data_length, __ATOMIC_RELAXED );
+        uint64_t capacity = __atomic_load_n( &header->capacity, __ATOMIC_RELAXED );
+        if ( capacity > 0 && length > capacity ) {
+            length = capacity;
+        }
+        uint64_t frame_timestamp_us = __atomic_load_n( &header->timestamp_us, __ATOMIC_RELAXED );
+        uint16_t flags = __atomic_load_n( &header->flags, __ATOMIC_RELAXED );
+        uint64_t checksum = __atomic_load_n( &header->checksum, __ATOMIC_RELAXED );
+
+        if ( length > *allocated_buffer_size || *data_buffer == NULL ) {
+            char *new_pointer = realloc( *data_buffer, length > 0 ? length : 1 );
+            if ( new_pointer == NULL ) {
+                printf( "Error: Could not allocate buffer with length: %lu.\n", (unsigned long) length );
+                return false;
+            }
+            *allocated_buffer_size = length;
+            *data_buffer = new_pointer;
+        }
+        memcpy( *data_buffer, data, length );
+
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+        if ( __atomic_load_n( &header->sequence, __ATOMIC_RELAXED ) != sequence_before ) {
+            // Overwritten while copying
+            continue;
+        }
+        if ( ( flags & NXAI_SHM_SEQLOCK_CHECKSUM ) && _shm_checksum( *data_buffer, length ) != checksum ) {
+            printf( "Warning: SHM data does not match its checksum.\n" );
+            return false;
+        }
+        *data_length = length;
+        if ( sequence != NULL ) {
+            *sequence = sequence_before;
+        }
+        if ( timestamp_us != NULL ) {
+            *timestamp_us = frame_timestamp_us;
+        }
+        return true;
+    }
+    errno = EAGAIN;
+    return false;
+}
+
+/**
+ * @brief Creates a memfd backed by huge pages and checks the pages can actually be reserved.
+ *
+ * @return The descriptor, or -1 if huge pages are not available.
+ */
+static int _shm_fd_create_huge( size_t segment_size ) {
+    int shm_fd = memfd_create( "nxai_shm", MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_HUGETLB | MFD_HUGE_2MB );
+    if ( shm_fd == -1 ) {
+        return -1;
+    }
+    size_t huge_size = ( segment_size + SHM_HUGE_PAGE_SIZE - 1 ) & ~( (size_t) SHM_HUGE_PAGE_SIZE - 1 );
+    if ( ftruncate( shm_fd, (off_t) huge_size ) == -1 ) {
+        close( shm_fd );
+        return -1;
+    }
+    // Huge pages are reserved when mapping, without free huge pages this fails
+    void *mapping = mmap( NULL, huge_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0 );
+    if ( mapping == MAP_FAILED ) {
+        close( shm_fd );
+        return -1;
+    }
+    munmap( mapping, huge_size );
+    return shm_fd;
+}
+
+int nxai_shm_fd_create( size_t size, unsigned int flags ) {
+    if ( flags & NXAI_SHM_FD_HUGE_PAGES ) {
+        int shm_fd = _shm_fd_create_huge( size + HEADER_BYTES );
+        if ( shm_fd != -1 ) {
+            return shm_fd;
+        }
+        printf( "Warning: Huge pages are not available for SHM, using normal pages: %s\n", strerror( errno ) );
+    }
+
+    int shm_fd = memfd_create( "nxai_shm", MFD_CLOEXEC | MFD_ALLOW_SEALING );
+    if ( shm_fd == -1 ) {
+        printf( "Failed to create SHM: %s\n", strerror( errno ) );
+        return -1;
+    }
+    if ( ftruncate( shm_fd, (off_t) ( size + HEADER_BYTES ) ) == -1 ) {
+        printf( "Failed to size SHM: %s\n", strerror( errno ) );
+        close( shm_fd );
+        return -1;
+    }
+    // Allocates the pages up front, mappings then only fault in page table entries
+    if ( ( flags & NXAI_SHM_PREFAULT ) && fallocate( shm_fd, 0, 0, (off_t) ( size + HEADER_BYTES ) ) == -1 ) {
+        printf( "Warning: Could not allocate SHM pages up front: %s\n", strerror( errno ) );
+    }
+    return shm_fd;
+}
+
+int nxai_shm_fd_create_named( const char *name, size_t size ) {
+    int shm_fd = shm_open( name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0666 );
+    if ( shm_fd == -1 ) {
+        printf( "Failed to create SHM %s: %s\n", name, strerror( errno ) );
+        return -1;
+    }
+    if ( ftruncate( shm_fd, (off_t) ( size + HEADER_BYTES ) ) == -1 ) {
+        printf( "Failed to size SHM %s: %s\n", name, strerror( errno ) );
+        close( shm_fd );
+        shm_unlink( name );
+        return -1;
+    }
+    return shm_fd;
+}
+
+int nxai_shm_fd_open_named( const char *name ) {
+    int shm_fd = shm_open( name, O_RDWR | O_CLOEXEC, 0 );
+    if ( shm_fd == -1 ) {
+        printf( "Could not open SHM %s: %s\n", name, strerror( errno ) );
+    }
+    return shm_fd;
+}
+
+int nxai_shm_fd_unlink_named( const char *name ) {
+    return shm_unlink( name );
+}
+
+bool nxai_shm_fd_seal( int shm_fd, bool seal_writes ) {
+    int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+    if ( seal_writes ) {
+        seals |= F_SEAL_WRITE;
+        // Sealing writes fails while a writable mapping exists
+        nxai_shm_fd_cache_evict( shm_fd );
+    }
+    if ( fcntl( shm_fd, F_ADD_SEALS, seals ) == -1 ) {
+        printf( "Could not seal SHM: %s\n", strerror( errno ) );
+        return false;
+    }
+    return true;
+}
+
+size_t nxai_shm_fd_get_size( int shm_fd ) {
+    struct stat file_status;
+    if ( fstat( shm_fd, &file_status ) == -1 || (size_t) file_status.st_size < HEADER_BYTES ) {
+        return 0;
+    }
+    return (size_t) file_status.st_size - HEADER_BYTES;
+}
+
+/**
+ * @brief Maps a whole descriptor backed segment.
+ *
+ * Pages are chosen when the segment is created, segments created with `NXAI_SHM_FD_HUGE_PAGES` are on
+ * huge pages in every mapping.
+ *
+ * @return The mapping, or MAP_FAILED.
+ */
+static void *_shm_fd_map( int shm_fd, int protection ) {
+    struct stat file_status;
+    if ( fstat( shm_fd, &file_status ) == -1 || file_status.st_size == 0 ) {
+        return MAP_FAILED;
+    }
+    size_t segment_size = (size_t) file_status.st_size;
+
+    return mmap( NULL, segment_size, protection, MAP_SHARED, shm_fd, 0 );
+}
+
+void *nxai_shm_fd_attach( int shm_fd ) {
+    void *result = _shm_fd_map( shm_fd, PROT_READ | PROT_WRITE );
+    if ( result == MAP_FAILED && ( errno == EPERM || errno == EACCES ) ) {
+        // Sealed against writes, or opened read-only
+        result = _shm_fd_map( shm_fd, PROT_READ );
+    }
+    return result;
+}
+
+/**
+ * @brief Unmaps a cached mapping and removes it from the cache. Called with the cache locked.
+ */
+static void _shm_fd_cache_remove( size_t index ) {
+    munmap( _fd_mappings[index].address, _fd_mappings[index].size );
+    _fd_mappings[index] = _fd_mappings[--_num_fd_mappings];
+}
+
+/**
+ * @brief Gets the cached writable mapping of a segment, mapping it if it is not cached yet.
+ *
+ * A segment that changed size is mapped again. When every cached mapping is in use, the segment is
+ * mapped without caching it.
+ *
+ * @param mapping_size Set to the size of the mapping.
+ * @param cached Set to whether the mapping is cached, otherwise the caller unmaps it.
+ *
+ * @return The mapping, or MAP_FAILED.
+ */
+static void *_shm_fd_cache_acquire( int shm_fd, size_t *mapping_size, bool *cached ) {
+    struct stat file_status;
+    if ( fstat( shm_fd, &file_status ) == -1 || file_status.st_size == 0 ) {
+        return MAP_FAILED;
+    }
+    *mapping_size = (size_t) file_status.st_size;
+
+    pthread_mutex_lock( &_fd_mappings_lock );
+    size_t index = 0;
+    while ( index < _num_fd_mappings ) {
+        _shm_fd_mapping_t *mapping = &_fd_mappings[index];
+        if ( mapping->device != file_status.st_dev || mapping->inode != file_status.st_ino || mapping->evicted == true ) {
+            index++;
+            continue;
+        }
+        if ( mapping->size == *mapping_size ) {
+            mapping->references++;
+            mapping->last_used = ++_fd_mappings_clock;
+            *cached = true;
+            pthread_mutex_unlock( &_fd_mappings_lock );
+            return mapping->address;
+        }
+        // Resized, map it again
+        mapping->evicted = true;
+        if ( mapping->references == 0 ) {
+            _shm_fd_cache_remove( index );
+        }
+        break;
+    }
+
+    if ( _num_fd_mappings == SHM_FD_CACHE_ENTRIES ) {
+        size_t oldest = SHM_FD_CACHE_ENTRIES;
+        for ( index = 0; index < _num_fd_mappings; index++ ) {
+            if ( _fd_mappings[index].references == 0 && ( oldest == SHM_FD_CACHE_ENTRIES || _fd_mappings[index].last_used < _fd_mappings[oldest].last_used ) ) {
+                oldest = index;
+            }
+        }
+        if ( oldest < SHM_FD_CACHE_ENTRIES ) {
+            _shm_fd_cache_remove( oldest );
+        }
+    }
+    void *address = _shm_fd_map( shm_fd, PROT_READ | PROT_WRITE );
+    *cached = address != MAP_FAILED && _num_fd_mappings < SHM_FD_CACHE_ENTRIES;
+    if ( *cached == true ) {
+        _fd_mappings[_num_fd_mappings++] = ( _shm_fd_mapping_t ) { .device = file_status.st_dev, .inode = file_status.st_ino, .address = address, .size = *mapping_size, .references = 1, .evicted = false, .last_used = ++_fd_mappings_clock };
+    }
+    pthread_mutex_unlock( &_fd_mappings_lock );
+    return address;
+}
+
+/**
+ * @brief Releases a mapping returned by `_shm_fd_cache_acquire`.
+ */
+static void _shm_fd_cache_release( void *address, size_t mapping_size, bool cached ) {
+    if ( cached == false ) {
+        munmap( address, mapping_size );
+        return;
+    }
+    pthread_mutex_lock( &_fd_mappings_lock );
+    for ( size_t index = 0; index < _num_fd_mappings; index++ ) {
+        if ( _fd_mappings[index].address == address && _fd_mappings[index].references > 0 ) {
+            _fd_mappings[index].references--;
+            if ( _fd_mappings[index].references == 0 && _fd_mappings[index].evicted == true ) {
+                _shm_fd_cache_remove( index );
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock( &_fd_mappings_lock );
+}
+
+bool nxai_shm_fd_write( int shm_fd, const char *data, size_t size ) {
+    size_t mapping_size = 0;
+    bool cached = false;
+    void *result = _shm_fd_cache_acquire( shm_fd, &mapping_size, &cached );
+    if ( result == MAP_FAILED ) {
+        return false;
+    }
+
+    bool written = _shm_write_to_segment( result, mapping_size, data, size );
+
+    _shm_fd_cache_release( result, mapping_size, cached );
+
+    return written;
+}
+
+void nxai_shm_fd_cache_evict( int shm_fd ) {
+    struct stat file_status;
+    if ( fstat( shm_fd, &file_status ) == -1 ) {
+        return;
+    }
+    pthread_mutex_lock( &_fd_mappings_lock );
+    size_t index = 0;
+    while ( index < _num_fd_mappings ) {
+        if ( _fd_mappings[index].device == file_status.st_dev && _fd_mappings[index].inode == file_status.st_ino ) {
+            _fd_mappings[index].evicted = true;
+            if ( _fd_mappings[index].references == 0 ) {
+                // The last entry moved to this index, check it next
+                _shm_fd_cache_remove( index );
+                continue;
+            }
+        }
+        index++;
+    }
+    pthread_mutex_unlock( &_fd_mappings_lock );
+}
+
+void *nxai_shm_fd_read( int shm_fd, size_t *data_length, char **payload_data ) {
+    void *shm_pointer = nxai_shm_fd_attach( shm_fd );
+    if ( shm_pointer == (void *) -1 ) {
+        return NULL;
+    }
+    nxai_shm_read_from_attached( shm_pointer, data_length, payload_data );
+    return shm_pointer;
+}
+
+void nxai_shm_fd_close( void *memory_address, size_t size ) {
+    munmap( memory_address, size + HEADER_BYTES );
+}
+
+/**
+ * @brief Shared header of a ring buffer, followed by the data area.
+ *
+ * Positions only increase, their offset in the data area is the position modulo the capacity.
+ * Fields written by producers and by the consumer are on separate cache lines.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t capacity;
+    // Producers claim space by advancing the reserve position
+    _Alignas( 64 ) uint64_t reserve_position;
+    // Claimed space is published in order by advancing the commit position
+    _Alignas( 64 ) uint64_t commit_position;
+    uint32_t data_signal;
+    uint32_t consumer_waiting;
+    // Consumer frees space by advancing the read position
+    _Alignas( 64 ) uint64_t read_position;
+    uint32_t space_signal;
+    uint32_t producers_waiting;
+    // Abandoned claims, published by whoever publishes up to their start. Free entries have end 0.
+    _Alignas( 64 ) struct {
+        uint64_t start;
+        uint64_t end;
+    } abandoned[RING_MAX_ABANDONED];
+} _shm_ring_header_t;
+
+struct nxai_shm_ring {
+    int shm_id;
+    _shm_ring_header_t *header;
+    char *data;
+    uint64_t capacity;
+    uint32_t timeout_ms;
+};
+
+static inline uint64_t _ring_record_size( uint32_t message_length ) {
+    return ( RING_RECORD_HEADER_BYTES + (uint64_t) message_length + RING_RECORD_ALIGNMENT - 1 ) & ~(uint64_t) ( RING_RECORD_ALIGNMENT - 1 );
+}
+
+static uint64_t _shm_now_ms( void ) {
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Waits on a futex word in shared memory while it still holds `expected`, up to the deadline.
+ *
+ * @return false if the deadline passed.
+ */
+static bool _shm_futex_wait( uint32_t *word, uint32_t expected, uint64_t deadline_ms ) {
+    uint64_t now_ms = _shm_now_ms();
+    if ( now_ms >= deadline_ms ) {
+        return false;
+    }
+    uint64_t remaining_ms = deadline_ms - now_ms;
+    struct timespec timeout = { .tv_sec = (time_t) ( remaining_ms / 1000 ), .tv_nsec = (long) ( remaining_ms % 1000 ) * 1000000 };
+    // Not a private futex, the word is shared between processes
+    syscall( SYS_futex, word, FUTEX_WAIT, expected, &timeout, NULL, 0 );
+    return true;
+}
+
+static void _shm_futex_wake( uint32_t *word, int num_waiters ) {
+    __atomic_fetch_add( word, 1, __ATOMIC_SEQ_CST );
+    syscall( SYS_futex, word, FUTEX_WAKE, num_waiters, NULL, NULL, 0 );
+}
+
+/**
+ * @brief Frees ring space up to `position` and wakes producers waiting for space.
+ */
+static void _ring_release( nxai_shm_ring_t *ring, uint64_t position ) {
+    __atomic_store_n( &ring->header->read_position, position, __ATOMIC_SEQ_CST );
+    if ( __atomic_load_n( &ring->header->producers_waiting, __ATOMIC_SEQ_CST ) != 0 ) {
+        _shm_futex_wake( &ring->header->space_signal, INT_MAX );
+    }
+}
+
+/**
+ * @brief Publishes a claim once all earlier claims are published, then the abandoned claims following it.
+ *
+ * @return false if the commit position was not at `position`, in which case nothing was published.
+ */
+static bool _ring_publish( _shm_ring_header_t *header, uint64_t position, uint64_t end ) {
+    if ( __atomic_load_n( &header->commit_position, __ATOMIC_ACQUIRE ) != position ||
+         __atomic_compare_exchange_n( &header->commit_position, &position, end, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) == false ) {
+        return false;
+    }
+    // Their producers stopped waiting for this publish
+    size_t index = 0;
+    while ( index < RING_MAX_ABANDONED ) {
+        if ( __atomic_load_n( &header->abandoned[index].start, __ATOMIC_SEQ_CST ) != end ) {
+            index++;
+            continue;
+        }
+        uint64_t abandoned_end = __atomic_load_n( &header->abandoned[index].end, __ATOMIC_ACQUIRE );
+        uint64_t expected = end;
+        if ( __atomic_compare_exchange_n( &header->commit_position, &expected, abandoned_end, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) == false ) {
+            // Its producer published it itself
+            break;
+        }
+        __atomic_store_n( &header->abandoned[index].start, 0, __ATOMIC_RELAXED );
+        __atomic_store_n( &header->abandoned[index].end, 0, __ATOMIC_RELEASE );
+        end = abandoned_end;
+        index = 0;
+    }
+    return true;
+}
+
+/**
+ * @brief Gives up on a claim whose earlier claims were not published in time.
+ *
+ * The record is marked so the consumer skips it and is left for the producer that publishes up to
+ * it, so a stalled or dead producer does not block the others forever.
+ *
+ * @return false if there was no room to leave the claim, the ring stays blocked at it.
+ */
+static bool _ring_abandon( _shm_ring_header_t *header, char *record, uint32_t message_length, uint64_t position, uint64_t end ) {
+    uint32_t record_length = RING_ABANDONED_RECORD;
+    memcpy( record, &record_length, sizeof( record_length ) );
+    memcpy( record + sizeof( record_length ), &message_length, sizeof( message_length ) );
+    for ( size_t index = 0; index < RING_MAX_ABANDONED; index++ ) {
+        uint64_t free_end = 0;
+        if ( __atomic_compare_exchange_n( &header->abandoned[index].end, &free_end, end, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) ) {
+            __atomic_store_n( &header->abandoned[index].start, position, __ATOMIC_SEQ_CST );
+            // The earlier claim may have been published before the entry was visible, then no other
+            // publish reaches the entry and it is freed here
+            if ( _ring_publish( header, position, end ) ) {
+                __atomic_store_n( &header->abandoned[index].start, 0, __ATOMIC_RELAXED );
+                __atomic_store_n( &header->abandoned[index].end, 0, __ATOMIC_RELEASE );
+            }
+            return true;
+        }
+    }
+    // Nothing publishes the record now, it is complete so it is kept as it is
+    memcpy( record, &message_length, sizeof( message_length ) );
+    printf( "Error: Ring buffer has too many abandoned messages, it stays blocked until earlier messages are published.\n" );
+    return false;
+}
+
+static nxai_shm_ring_t *_ring_open( int shm_id ) {
+    void *memory = shmat( shm_id, NULL, 0 );
+    if ( memory == (void *) -1 ) {
+        printf( "Error: Could not attach ring buffer: %s\n", strerror( errno ) );
+        return NULL;
+    }
+    nxai_shm_ring_t *ring = malloc( sizeof( nxai_shm_ring_t ) );
+    if ( ring == NULL ) {
+        shmdt( memory );
+        return NULL;
+    }
+    ring->shm_id = shm_id;
+    ring->header = memory;
+    ring->data = (char *) memory + sizeof( _shm_ring_header_t );
+    ring->capacity = ring->header->capacity;
+    ring->timeout_ms = 1000;
+    return ring;
+}
+
+nxai_shm_ring_t *nxai_shm_ring_create( key_t shm_key, size_t capacity ) {
+    // Power of two capacity, so records and padding are always a multiple of the alignment
+    uint64_t ring_capacity = RING_RECORD_ALIGNMENT * 8;
+    while ( ring_capacity < capacity ) {
+        ring_capacity <<= 1;
+    }
+    int shm_id = shmget( shm_key, sizeof( _shm_ring_header_t ) + ring_capacity, 0666 | IPC_CREAT );
+    if ( shm_id == -1 ) {
+        printf( "Error: Could not create ring buffer: %s\n", strerror( errno ) );
+        return NULL;
+    }
+    void *memory = shmat( shm_id, NULL, 0 );
+    if ( memory == (void *) -1 ) {
+        printf( "Error: Could not attach ring buffer: %s\n", strerror( errno ) );
+        return NULL;
+    }
+    _shm_ring_header_t *header = memory;
+    memset( header, 0, sizeof( _shm_ring_header_t ) );
+    header->capacity = ring_capacity;
+    // Publish the magic last, attaching processes check it
+    __atomic_store_n( &header->magic, RING_MAGIC, __ATOMIC_RELEASE );
+    shmdt( memory );
+    return _ring_open( shm_id );
+}
+
+nxai_shm_ring_t *nxai_shm_ring_attach( key_t shm_key ) {
+    int shm_id = shmget( shm_key, 0, 0 );
+    if ( shm_id == -1 ) {
+        printf( "Error: Could not get ring buffer: %s\n", strerror( errno ) );
+        return NULL;
+    }
+    nxai_shm_ring_t *ring = _ring_open( shm_id );
+    if ( ring != NULL && __atomic_load_n( &ring->header->magic, __ATOMIC_ACQUIRE ) != RING_MAGIC ) {
+        printf( "Error: Shared memory is not an initialised ring buffer.\n" );
+        nxai_shm_ring_close( ring );
+        return NULL;
+    }
+    return ring;
+}
+
+void nxai_shm_ring_set_timeout( nxai_shm_ring_t *ring, uint32_t timeout_ms ) {
+    ring->timeout_ms = timeout_ms;
+}
+
+int nxai_shm_ring_get_id( nxai_shm_ring_t *ring ) {
+    return ring->shm_id;
+}
+
+bool nxai_shm_ring_send( nxai_shm_ring_t *ring, const char *message, uint32_t message_length ) {
+    _shm_ring_header_t *header = ring->header;
+    uint64_t record_size = _ring_record_size( message_length );
+    if ( message_length >= RING_ABANDONED_RECORD || record_size > ring->capacity ) {
+        printf( "Warning: Message of %u bytes does not fit in ring buffer of %lu bytes\n", message_length, (unsigned long) ring->capacity );
+        return false;
+    }
+    uint64_t deadline_ms = _shm_now_ms() + ring->timeout_ms;
+
+    // Claim space, skipping the end of the ring if the record does not fit there
+    uint64_t position = __atomic_load_n( &header->reserve_position, __ATOMIC_RELAXED );
+    uint64_t padding;
+    while ( true ) {
+        uint64_t offset = position & ( ring->capacity - 1 );
+        padding = offset + record_size > ring->capacity ? ring->capacity - offset : 0;
+        uint64_t read_position = __atomic_load_n( &header->read_position, __ATOMIC_ACQUIRE );
+        if ( position + padding + record_size - read_position > ring->capacity ) {
+            // Ring is full, wait for the consumer to free space
+            __atomic_fetch_add( &header->producers_waiting, 1, __ATOMIC_SEQ_CST );
+            uint32_t signal = __atomic_load_n( &header->space_signal, __ATOMIC_SEQ_CST );
+            bool in_time = true;
+            if ( __atomic_load_n( &header->read_position, __ATOMIC_SEQ_CST ) == read_position ) {
+                in_time = _shm_futex_wait( &header->space_signal, signal, deadline_ms );
+            }
+            __atomic_fetch_sub( &header->producers_waiting, 1, __ATOMIC_SEQ_CST );
+            if ( in_time == false ) {
+                return false;
+            }
+            position = __atomic_load_n( &header->reserve_position, __ATOMIC_RELAXED );
+            continue;
+        }
+        if ( __atomic_compare_exchange_n( &header->reserve_position, &position, position + padding + record_size, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) ) {
+            break;
+        }
+    }
+
+    // Write the record
+    uint32_t record_length = RING_PADDING_RECORD;
+    if ( padding > 0 ) {
+        memcpy( ring->data + ( position & ( ring->capacity - 1 ) ), &record_length, sizeof( record_length ) );
+    }
+    char *record = ring->data + ( ( position + padding ) & ( ring->capacity - 1 ) );
+    memcpy( record, &message_length, sizeof( message_length ) );
+    memcpy( record + RING_RECORD_HEADER_BYTES, message, message_length );
+
+    // Publish after all earlier claims are published, so the consumer only sees complete records. An
+    // earlier producer that stalls past the deadline makes this claim be skipped instead.
+    for ( uint32_t spins = 0; _ring_publish( header, position, position + padding + record_size ) == false; spins++ ) {
+        if ( spins >= RING_PUBLISH_SPINS ) {
+            if ( _shm_now_ms() >= deadline_ms ) {
+                printf( "Warning: Timed out waiting for an earlier message to be published to the ring buffer\n" );
+                _ring_abandon( header, record, message_length, position, position + padding + record_size );
+                return false;
+            }
+            sched_yield();
+        }
+    }
+    if ( __atomic_load_n( &header->consumer_waiting, __ATOMIC_SEQ_CST ) != 0 ) {
+        _shm_futex_wake( &header->data_signal, 1 );
+    }
+    return true;
+}
+
+bool nxai_shm_ring_receive( nxai_shm_ring_t *ring, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length ) {
+    _shm_ring_header_t *header = ring->header;
+    uint64_t deadline_ms = _shm_now_ms() + ring->timeout_ms;
+    uint64_t position = __atomic_load_n( &header->read_position, __ATOMIC_RELAXED );
+    *message_length = 0;
+
+    while ( true ) {
+        uint64_t commit_position = __atomic_load_n( &header->commit_position, __ATOMIC_ACQUIRE );
+        if ( commit_position == position ) {
+            // Ring is empty, wait for a producer to publish
+            __atomic_store_n( &header->consumer_waiting, 1, __ATOMIC_SEQ_CST );
+            uint32_t signal = __atomic_load_n( &header->data_signal, __ATOMIC_SEQ_CST );
+            bool in_time = true;
+            if ( __atomic_load_n( &header->commit_position, __ATOMIC_SEQ_CST ) == position ) {
+                in_time = _shm_futex_wait( &header->data_signal, signal, deadline_ms );
+            }
+            __atomic_store_n( &header->consumer_waiting, 0, __ATOMIC_SEQ_CST );
+            if ( in_time == false ) {
+                return false;
+            }
+            continue;
+        }
+
+        uint64_t offset = position & ( ring->capacity - 1 );
+        uint32_t record_length;
+        memcpy( &record_length, ring->data + offset, sizeof( record_length ) );
+        if ( record_length == RING_PADDING_RECORD ) {
+            position += ring->capacity - offset;
+            _ring_release( ring, position );
+            continue;
+        }
+        if ( record_length == RING_ABANDONED_RECORD ) {
+            memcpy( &record_length, ring->data + offset + sizeof( record_length ), sizeof( record_length ) );
+            position += _ring_record_size( record_length );
+            _ring_release( ring, position );
+            continue;
+        }
+
+        // Copy the message out, so its space can be reused right away
+        if ( record_length > *allocated_buffer_size || *message_input_buffer == NULL ) {
+            char *new_pointer = realloc( *message_input_buffer, record_length > 0 ? record_length : 1 );
+            if ( new_pointer == NULL ) {
+                printf( "Error: Could not allocate buffer with length: %u. Ignoring message.\n", record_length );
+                _ring_release( ring, position + _ring_record_size( record_length ) );
+                return false;
+            }
+            *allocated_buffer_size = record_length;
+            *message_input_buffer = new_pointer;
+        }
+        memcpy( *message_input_buffer, ring->data + offset + RING_RECORD_HEADER_BYTES, record_length );
+        *message_length = record_length;
+        break;
+    }
+
+    _ring_release( ring, position + _ring_record_size( *message_length ) );
+    return true;
+}
+
+void nxai_shm_ring_close( nxai_shm_ring_t *ring ) {
+    if ( ring == NULL ) {
+        return;
+    }
+    shmdt( ring->header );
+    free( ring );
+}
+
+int nxai_shm_ring_destroy( nxai_shm_ring_t *ring ) {
+    int result = nxai_shm_destroy( ring->shm_id );
+    nxai_shm_ring_close( ring );
+    return result;
+}
+
+/**
+ * @brief Shared header of a frame pool, followed by the slot states and the frame data.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t num_slots;
+    uint64_t slot_size;
+    // Published frames are numbered, so consumers take the oldest ready frame first
+    _Alignas( 64 ) uint64_t publish_sequence;
+    uint32_t ready_signal;
+    uint32_t consumers_waiting;
+    // Signalled when a slot is released
+    _Alignas( 64 ) uint32_t free_signal;
+    uint32_t producers_waiting;
+} _shm_frame_pool_header_t;
+
+// State of a single slot, each on its own cache line
+typedef struct {
+    _Alignas( 64 ) uint32_t state;
+    uint32_t frame_length;
+    uint64_t sequence;
+} _shm_frame_slot_t;
+
+struct nxai_shm_frame_pool {
+    int shm_id;
+    _shm_frame_pool_header_t *header;
+    _shm_frame_slot_t *slots;
+    char *data;
+    uint32_t num_slots;
+    uint64_t slot_stride;
+    uint32_t timeout_ms;
+};
+
+static inline uint64_t _frame_pool_slot_stride( uint64_t slot_size ) {
+    return ( slot_size + FRAME_POOL_ALIGNMENT - 1 ) & ~(uint64_t) ( FRAME_POOL_ALIGNMENT - 1 );
+}
+
+static nxai_shm_frame_pool_t *_frame_pool_open( int shm_id ) {
+    void *memory = shmat( shm_id, NULL, 0 );
+    if ( memory == (void *) -1 ) {
+        printf( "Error: Could not attach frame pool: %s\n", strerror( errno ) );
+        return NULL;
+    }
+    nxai_shm_frame_pool_t *pool = malloc( sizeof( nxai_shm_frame_pool_t ) );
+    if ( pool == NULL ) {
+        shmdt( memory );
+        return NULL;
+    }
+    pool->shm_id = shm_id;
+    pool->header = memory;
+    pool->slots = (_shm_frame_slot_t *) ( (char *) memory + sizeof( _shm_frame_pool_header_t ) );
+    pool->num_slots = pool->header->num_slots;
+    pool->data = (char *) ( pool->slots + pool->num_slots );
+    pool->slot_stride = _frame_pool_slot_stride( pool->header->slot_size );
+    pool->timeout_ms = 1000;
+    return pool;
+}
+
+nxai_shm_frame_pool_t *nxai_shm_frame_pool_create( key_t shm_key, uint32_t num_slots, size_t slot_size ) {
+    if ( num_slots == 0 || slot_size == 0 ) {
+        printf( "Error: Frame pool needs at least one slot of at least one byte.\n" );
+        return NULL;
+    }
+    size_t segment_size = sizeof( _shm_frame_pool_header_t ) + num_slots * ( sizeof( _shm_frame_slot_t ) + _frame_pool_slot_stride( slot_size ) );
+    int shm_id = shmget( shm_key, segment_size, 0666 | IPC_CREAT );
+    if ( shm_id == -1 ) {
+        printf( "Error: Could not create frame pool: %s\n", strerror( errno ) );
+        return NULL;
+    }
+    void *memory = shmat( shm_id, NULL, 0 );
+    if ( memory == (void *) -1 ) {
+        printf( "Error: Could not attach frame pool: %s\n", strerror( errno ) );
+        return NULL;
+    }
+    // All slots start free, zeroed memory
+    memset( memory, 0, sizeof( _shm_frame_pool_header_t ) + num_slots * sizeof( _shm_frame_slot_t ) );
+    _shm_frame_pool_header_t *header = memory;
+    header->num_slots = num_slots;
+    header->slot_size = slot_size;
+    // Publish the magic last, attaching processes check it
+    __atomic_store_n( &header->magic, FRAME_POOL_MAGIC, __ATOMIC_RELEASE );
+    shmdt( memory );
+    return _frame_pool_open( shm_id );
+}
+
+nxai_shm_frame_pool_t *nxai_shm_frame_pool_attach( key_t shm_key ) {
+    int shm_id = shmget( shm_key, 0, 0 );
+    if ( shm_id == -1 ) {
+        printf( "Error: Could not get frame pool: %s\n", strerror( errno ) );
+        return NULL;
+    }
+    // Check the magic before trusting the slot count in the header
+    _shm_frame_pool_header_t *header = shmat( shm_id, NULL, SHM_RDONLY );
+    if ( header == (void *) -1 ) {
+        printf( "Error: Could not attach frame pool: %s\n", strerror( errno ) );
+        return NULL;
+    }
+    bool initialised = __atomic_load_n( &header->magic, __ATOMIC_ACQUIRE ) == FRAME_POOL_MAGIC;
+    shmdt( header );
+    if ( initialised == false ) {
+        printf( "Error: Shared memory is not an initialised frame pool.\n" );
+        return NULL;
+    }
+    return _frame_pool_open( shm_id );
+}
+
+void nxai_shm_frame_pool_set_timeout( nxai_shm_frame_pool_t *pool, uint32_t timeout_ms ) {
+    pool->timeout_ms = timeout_ms;
+}
+
+int nxai_shm_frame_pool_get_id( nxai_shm_frame_pool_t *pool ) {
+    return pool->shm_id;
+}
+
+size_t nxai_shm_frame_pool_get_slot_size( nxai_shm_frame_pool_t *pool ) {
+    return pool->header->slot_size;
+}
+
+/**
+ * @brief Moves a slot from one state to another if it is in the expected state.
+ */
+static inline bool _frame_pool_claim( nxai_shm_frame_pool_t *pool, uint32_t slot, uint32_t from_state, uint32_t to_state ) {
+    uint32_t expected = from_state;
+    return __atomic_compare_exchange_n( &pool->slots[slot].state, &expected, to_state, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED );
+}
+
+/**
+ * @brief Claims a free slot for writing.
+ *
+ * @return The slot, or num_slots if none is free.
+ */
+static uint32_t _frame_pool_claim_free( nxai_shm_frame_pool_t *pool ) {
+    for ( uint32_t slot = 0; slot < pool->num_slots; slot++ ) {
+        if ( __atomic_load_n( &pool->slots[slot].state, __ATOMIC_RELAXED ) == FRAME_SLOT_FREE && _frame_pool_claim( pool, slot, FRAME_SLOT_FREE, FRAME_SLOT_WRITING ) ) {
+            return slot;
+        }
+    }
+    return pool->num_slots;
+}
+
+/**
+ * @brief Claims the oldest ready slot for reading.
+ *
+ * @return The slot, or num_slots if none is ready.
+ */
+static uint32_t _frame_pool_claim_ready( nxai_shm_frame_pool_t *pool ) {
+    while ( true ) {
+        uint32_t oldest = pool->num_slots;
+        uint64_t oldest_sequence = UINT64_MAX;
+        for ( uint32_t slot = 0; slot < pool->num_slots; slot++ ) {
+            if ( __atomic_load_n( &pool->slots[slot].state, __ATOMIC_ACQUIRE ) != FRAME_SLOT_READY ) {
+                continue;
+            }
+            uint64_t sequence = __atomic_load_n( &pool->slots[slot].sequence, __ATOMIC_RELAXED );
+            if ( sequence < oldest_sequence ) {
+                oldest = slot;
+                oldest_sequence = sequence;
+            }
+        }
+        if ( oldest == pool->num_slots || _frame_pool_claim( pool, oldest, FRAME_SLOT_READY, FRAME_SLOT_READING ) ) {
+            return oldest;
+        }
+        // Another consumer took it first, look again
+    }
+}
+
+char *nxai_shm_frame_pool_acquire( nxai_shm_frame_pool_t *pool, uint32_t *slot ) {
+    _shm_frame_pool_header_t *header = pool->header;
+    uint64_t deadline_ms = _shm_now_ms() + pool->timeout_ms;
+
+    uint32_t claimed = _frame_pool_claim_free( pool );
+    while ( claimed == pool->num_slots ) {
+        // All slots are in use, wait for one to be released
+        __atomic_fetch_add( &header->producers_waiting, 1, __ATOMIC_SEQ_CST );
+        uint32_t signal = __atomic_load_n( &header->free_signal, __ATOMIC_SEQ_CST );
+        claimed = _frame_pool_claim_free( pool );
+        bool in_time = true;
+        if ( claimed == pool->num_slots ) {
+            in_time = _shm_futex_wait( &header->free_signal, signal, deadline_ms );
+        }
+        __atomic_fetch_sub( &header->producers_waiting, 1, __ATOMIC_SEQ_CST );
+        if ( in_time == false ) {
+            return NULL;
+        }
+        if ( claimed == pool->num_slots ) {
+            claimed = _frame_pool_claim_free( pool );
+        }
+    }
+    *slot = claimed;
+    return pool->data + claimed * pool->slot_stride;
+}
+
+bool nxai_shm_frame_pool_publish( nxai_shm_frame_pool_t *pool, uint32_t slot, uint32_t frame_length ) {
+    if ( slot >= pool->num_slots || frame_length > pool->header->slot_size ) {
+        printf( "Warning: Can not publish frame of %u bytes in slot %u of frame pool.\n", frame_length, slot );
+        return false;
+    }
+    _shm_frame_slot_t *slot_state = &pool->slots[slot];
+    if ( __atomic_load_n( &slot_state->state, __ATOMIC_RELAXED ) != FRAME_SLOT_WRITING ) {
+        printf( "Warning: Slot %u of frame pool was not acquired for writing.\n", slot );
+        return false;
+    }
+    slot_state->frame_length = frame_length;
+    __atomic_store_n( &slot_state->sequence, __atomic_fetch_add( &pool->header->publish_sequence, 1, __ATOMIC_RELAXED ), __ATOMIC_RELAXED );
+    // Frame data and length become visible to the consumer together with the state
+    __atomic_store_n( &slot_state->state, FRAME_SLOT_READY, __ATOMIC_SEQ_CST );
+    if ( __atomic_load_n( &pool->header->consumers_waiting, __ATOMIC_SEQ_CST ) != 0 ) {
+        _shm_futex_wake( &pool->header->ready_signal, INT_MAX );
+    }
+    return true;
+}
+
+const char *nxai_shm_frame_pool_take( nxai_shm_frame_pool_t *pool, uint32_t *slot, uint32_t *frame_length ) {
+    _shm_frame_pool_header_t *header = pool->header;
+    uint64_t deadline_ms = _shm_now_ms() + pool->timeout_ms;
+    *frame_length = 0;
+
+    uint32_t claimed = _frame_pool_claim_ready( pool );
+    while ( claimed == pool->num_slots ) {
+        // No frame is ready, wait for one to be published
+        __atomic_fetch_add( &header->consumers_waiting, 1, __ATOMIC_SEQ_CST );
+        uint32_t signal = __atomic_load_n( &header->ready_signal, __ATOMIC_SEQ_CST );
+        claimed = _frame_pool_claim_ready( pool );
+        bool in_time = true;
+        if ( claimed == pool->num_slots ) {
+            in_time = _shm_futex_wait( &header->ready_signal, signal, deadline_ms );
+        }
+        __atomic_fetch_sub( &header->consumers_waiting, 1, __ATOMIC_SEQ_CST );
+        if ( in_time == false ) {
+            return NULL;
+        }
+        if ( claimed == pool->num_slots ) {
+            claimed = _frame_pool_claim_ready( pool );
+        }
+    }
+    *slot = claimed;
+    *frame_length = pool->slots[claimed].frame_length;
+    return pool->data + claimed * pool->slot_stride;
+}
+
+bool nxai_shm_frame_pool_release( nxai_shm_frame_pool_t *pool, uint32_t slot ) {
+    if ( slot >= pool->num_slots || _frame_pool_claim( pool, slot, FRAME_SLOT_READING, FRAME_SLOT_FREE ) == false ) {
+        printf( "Warning: Slot %u of frame pool was not taken for reading.\n", slot );
+        return false;
+    }
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+    if ( __atomic_load_n( &pool->header->producers_waiting, __ATOMIC_SEQ_CST ) != 0 ) {
+        _shm_futex_wake( &pool->header->free_signal, INT_MAX );
+    }
+    return true;
+}
+
+void nxai_shm_frame_pool_close( nxai_shm_frame_pool_t *pool ) {
+    if ( pool == NULL ) {
+        return;
+    }
+    shmdt( pool->header );
+    free( pool );
+}
+
+int nxai_shm_frame_pool_destroy( nxai_shm_frame_pool_t *pool ) {
+    int result = nxai_shm_destroy( pool->shm_id );
+    nxai_shm_frame_pool_close( pool );
+    return result;
+}
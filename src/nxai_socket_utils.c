@@ -1,4 +1,9 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "nxai_socket_utils.h"
+#include "nxai_process_utils.h"
 
 #include <errno.h>
 #include <stdbool.h>
@@ -10,11 +15,28 @@
 #include <unistd.h>
 
 // Socket stuff
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/un.h>
 
+// io_uring is used when the kernel headers support multishot receive, otherwise listeners use epoll
+#if defined( __has_include )
+#if __has_include( <linux/io_uring.h> )
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+#if defined( IORING_RECV_MULTISHOT ) && defined( __NR_io_uring_setup )
+#define NXAI_SOCKET_IO_URING 1
+#endif
+
 #ifdef NXAI_DEBUG
 #include "memory_leak_detector.h"
 #endif
@@ -23,9 +45,127 @@ const uint8_t MESSAGE_HEADER_LENGTH = 4;
 
 bool nxai_socket_interrupt_signal = false;
 
-// Create timeout structure for socket connections
+// Default send and receive timeout, applied once when a socket is created
 static struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
 
+// Deadline value for operations that use the socket's own timeout
+#define NO_DEADLINE UINT64_MAX
+
+// Largest message that is received into memory, larger messages can only be received streaming
+static uint32_t max_message_size = UINT32_MAX;
+
+// Size of the pieces in which streaming receives hand a message to their callback
+#define STREAM_CHUNK_SIZE 65536
+
+// Receive buffer pool size classes, from 1 KB up to 64 MB
+#define BUFFER_POOL_MIN_CLASS_SHIFT 10
+#define BUFFER_POOL_NUM_CLASSES 17
+// Buffers larger than the largest size class are not cached
+#define BUFFER_POOL_UNCACHED BUFFER_POOL_NUM_CLASSES
+
+// Batch messages start with a magic number and the record count, each record has a length header.
+// Whether a message is a batch is agreed on by both sides, the magic number only guards against mistakes.
+#define BATCH_MAGIC 0x3142584E// "NXB1"
+#define BATCH_HEADER_LENGTH 8
+// Largest record that fits in a batch message, together with the batch and record headers
+#define BATCH_MAX_RECORD_LENGTH ( UINT32_MAX - BATCH_HEADER_LENGTH - 4 )
+
+// Event loop tuning for the listener. The staging buffer also holds a complete packet.
+#define LISTENER_MAX_EVENTS 64
+#define LISTENER_STAGING_BUFFER_SIZE NXAI_SOCKET_MAX_PACKET_SIZE
+#define LISTENER_READS_PER_EVENT 16
+
+// Process wide event used to wake up listeners when they should stop
+static int _interrupt_event_fd = -1;
+static pthread_once_t _interrupt_event_once = PTHREAD_ONCE_INIT;
+
+// Process wide socket metrics, only updated with relaxed atomics so counting never blocks
+static nxai_socket_metrics_t _metrics;
+
+// Receive state of a single connection in the listener event loop
+typedef struct _listener_connection {
+    int connection_fd;
+    size_t table_index;
+    // When the listener accepted the connection, and whether a callback already ran for it
+    uint64_t accepted_us;
+    bool callback_started;
+    // Header bytes of the message currently being received
+    size_t header_received;
+    uint32_t message_length;
+    // Buffer in which messages that arrive in pieces are reassembled
+    char *message_buffer;
+    size_t allocated_buffer_size;
+    size_t message_received;
+    // File descriptors received with the message currently being received
+    int pending_fds[NXAI_SOCKET_MAX_FDS];
+    size_t num_pending_fds;
+    // Set when the connection was shut down and only waits for its pending read to finish
+    bool closing;
+    // Messages queued for or being handled by a pool worker, protected by the pool lock
+    size_t num_queued;
+    // Set while reading is paused because the connection reached the pipeline depth, only cleared by the
+    // event loop once a worker put the connection on the resume list. Protected by the pool lock.
+    bool paused;
+    bool resume_pending;
+    struct _listener_connection *resume_next;
+    // Received data that was not consumed because reading paused, consumed first when it resumes
+    char *backlog;
+    size_t backlog_length;
+} _listener_connection_t;
+
+// Unit of work handed to a listener worker. A NULL message asks the worker to close the connection.
+typedef struct {
+    int connection_fd;
+    _listener_connection_t *connection;
+    char *message;
+    uint32_t message_length;
+} _listener_work_item_t;
+
+typedef struct _listener_pool _listener_pool_t;
+
+// Worker thread, remembers which connection it is handling
+typedef struct {
+    pthread_t thread;
+    int active_connection_fd;
+    _listener_pool_t *pool;
+} _listener_worker_t;
+
+// Worker pool with one bounded queue shared by all workers. A worker never takes a message of a
+// connection another worker is handling, so messages of a connection are handled in order.
+struct _listener_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    pthread_cond_t not_full;
+    _listener_work_item_t *items;
+    size_t capacity;
+    size_t count;
+    bool stopping;
+    _listener_worker_t *workers;
+    size_t num_workers;
+    void ( *callback_function )( const char *, uint32_t, int );
+    // Messages read ahead per connection before reading from it pauses, 0 for no limit
+    size_t pipeline_depth;
+    // Paused connections that can be read again, the event loop is woken through the event
+    _listener_connection_t *resume_list;
+    int resume_event_fd;
+};
+
+// State shared by the listener event loop and its optional worker pool
+typedef struct {
+    // SOCK_STREAM for length prefixed messages, SOCK_SEQPACKET for one message per packet
+    int socket_type;
+    void ( *callback_function )( const char *, uint32_t, int );
+    // Callback that also takes received file descriptors, used instead of callback_function when set
+    void ( *fd_callback_function )( const char *, uint32_t, int, const int *, size_t );
+    // Worker pool, NULL when callbacks run on the event loop thread
+    _listener_pool_t *pool;
+    // Internal handler that replaces the callbacks, used by the asynchronous client to reuse message reassembly
+    void ( *message_handler )( void *handler_context, _listener_connection_t *connection, const char *message, uint32_t message_length );
+    void *handler_context;
+    // Every message is a batch, the callback is run for each of its records
+    bool split_batches;
+} _listener_t;
+
 uint32_t nxai_socket_send_receive_message( const char *socket_path, const char *message_to_send, const uint32_t sending_message_length, char **return_message_buffer, size_t *allocated_message_length ) {
     // Create new socket
     int32_t connection_fd = nxai_socket_connect( socket_path );
@@ -33,29 +173,39 @@ uint32_t nxai_socket_send_receive_message( const char *socket_path, const char *
         return 0;
     }
 
+    uint32_t received_message_length = nxai_socket_send_receive_on_connection( connection_fd, message_to_send, sending_message_length, return_message_buffer, allocated_message_length );
+
+    // Close socket connection
+    close( connection_fd );
+
+    return received_message_length;
+}
+
+uint32_t nxai_socket_send_receive_on_connection( const int connection_fd, const char *message_to_send, const uint32_t sending_message_length, char **return_message_buffer, size_t *allocated_message_length ) {
     // Send message to connection
-    bool send_success = nxai_socket_send_to_connection( connection_fd, message_to_send, sending_message_length );
-    if ( send_success == false ) {
-        close( connection_fd );
+    if ( nxai_socket_send_to_connection( connection_fd, message_to_send, sending_message_length ) == false ) {
         return 0;
     }
 
     // Receive response on connection
-    uint32_t received_message_length;
-    nxai_socket_receive_on_connection( connection_fd, allocated_message_length, return_message_buffer, &received_message_length );
-
-    // Close socket connection
-    close( connection_fd );
+    uint32_t received_message_length = 0;
+    if ( nxai_socket_receive_on_connection( connection_fd, allocated_message_length, return_message_buffer, &received_message_length ) == false ) {
+        return 0;
+    }
 
     return received_message_length;
 }
 
 int nxai_socket_create_listener( const char *socket_path ) {
+    return nxai_socket_create_listener_with_type( socket_path, SOCK_STREAM );
+}
+
+int nxai_socket_create_listener_with_type( const char *socket_path, int socket_type ) {
     // Init socket to receive data
     struct sockaddr_un addr;
 
     // Create socket to listen on
-    int socket_fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    int socket_fd = socket( AF_UNIX, socket_type, 0 );
     if ( socket_fd == -1 ) {
         printf( "Error: Sender socket error.\n" );
         return -1;
@@ -91,24 +241,170 @@ int nxai_socket_create_listener( const char *socket_path ) {
     // Change file permissions so anyone can write to it
     chmod( socket_path, S_IRGRP | S_IRUSR | S_IROTH | S_IWGRP | S_IWOTH | S_IWUSR );
 
-    // Set timeout for socket
+    // Set timeouts for socket, accepted connections inherit them
+    setsockopt( socket_fd, SOL_SOCKET, SO_SNDTIMEO, (const char *) &tv, sizeof tv );
     setsockopt( socket_fd, SOL_SOCKET, SO_RCVTIMEO, (const char *) &tv, sizeof tv );
 
     return socket_fd;
 }
 
-void nxai_socket_receive_on_connection( int connection_fd, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length ) {
+/**
+ * @brief Takes the file descriptors out of the control messages of a received message.
+ *
+ * Descriptors that do not fit in the output array are closed, so they do not leak.
+ *
+ * @return The number of descriptors stored in `fds`.
+ */
+static size_t _collect_fds( struct msghdr *message, int *fds, size_t capacity ) {
+    size_t num_fds = 0;
+    for ( struct cmsghdr *control = CMSG_FIRSTHDR( message ); control != NULL; control = CMSG_NXTHDR( message, control ) ) {
+        if ( control->cmsg_level != SOL_SOCKET || control->cmsg_type != SCM_RIGHTS ) {
+            continue;
+        }
+        size_t num_control_fds = ( control->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int );
+        for ( size_t index = 0; index < num_control_fds; index++ ) {
+            int fd;
+            memcpy( &fd, CMSG_DATA( control ) + index * sizeof( int ), sizeof( int ) );
+            if ( num_fds < capacity ) {
+                fds[num_fds++] = fd;
+            } else {
+                close( fd );
+            }
+        }
+    }
+    if ( message->msg_flags & MSG_CTRUNC ) {
+        printf( "Warning: Received more file descriptors than fit in the control buffer, some were dropped.\n" );
+    }
+    return num_fds;
+}
+
+static void _close_fds( const int *fds, size_t num_fds ) {
+    for ( size_t index = 0; index < num_fds; index++ ) {
+        close( fds[index] );
+    }
+}
+
+static void _metrics_add( uint64_t *counter, uint64_t value ) {
+    __atomic_fetch_add( counter, value, __ATOMIC_RELAXED );
+}
+
+/**
+ * @brief Adds the time between two timestamps to a log2 histogram.
+ */
+static void _metrics_record_duration( uint64_t *histogram, uint64_t started_us, uint64_t ended_us ) {
+    // The timestamps are monotonic, the check only keeps a pair passed in the wrong order from wrapping
+    uint64_t duration_us = ended_us > started_us ? ended_us - started_us : 0;
+    size_t bucket = duration_us == 0 ? 0 : 64 - (size_t) __builtin_clzll( duration_us );
+    if ( bucket >= NXAI_SOCKET_METRICS_HISTOGRAM_BUCKETS ) {
+        bucket = NXAI_SOCKET_METRICS_HISTOGRAM_BUCKETS - 1;
+    }
+    _metrics_add( &histogram[bucket], 1 );
+}
+
+static void _metrics_count_received( uint32_t message_length ) {
+    _metrics_add( &_metrics.messages_received, 1 );
+    _metrics_add( &_metrics.bytes_received, message_length );
+}
+
+static void _metrics_count_sent( uint32_t message_length ) {
+    _metrics_add( &_metrics.messages_sent, 1 );
+    _metrics_add( &_metrics.bytes_sent, message_length );
+}
+
+/**
+ * @brief Counts a failed receive.
+ *
+ * @param error errno of the failure, 0 if the peer closed the connection.
+ * @param partial Whether part of the message was already received.
+ */
+static void _metrics_count_receive_failure( int error, bool partial ) {
+    if ( partial == true ) {
+        _metrics_add( &_metrics.partial_reads, 1 );
+    }
+    if ( error == EAGAIN || error == EWOULDBLOCK || error == ETIMEDOUT ) {
+        _metrics_add( &_metrics.timeouts, 1 );
+    } else if ( error != 0 && error != ECONNRESET ) {
+        _metrics_add( &_metrics.receive_errors, 1 );
+    }
+}
+
+/**
+ * @brief Counts a failed send from errno.
+ */
+static void _metrics_count_send_failure( void ) {
+    if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == ETIMEDOUT ) {
+        _metrics_add( &_metrics.timeouts, 1 );
+    } else {
+        _metrics_add( &_metrics.send_errors, 1 );
+    }
+}
+
+/**
+ * @brief Checks the length of an incoming message against the maximum message size.
+ *
+ * @return true if the message may be received, false with errno set to EMSGSIZE otherwise.
+ */
+static bool _message_size_allowed( uint32_t message_length ) {
+    if ( message_length <= max_message_size ) {
+        return true;
+    }
+    printf( "Warning: Message of %u bytes is larger than the maximum message size of %u bytes, ignoring message.\n", message_length, max_message_size );
+    _metrics_count_receive_failure( EMSGSIZE, false );
+    errno = EMSGSIZE;
+    return false;
+}
+
+void nxai_socket_get_metrics( nxai_socket_metrics_t *metrics ) {
+    // The metrics are only made of counters, copy them one at a time
+    const uint64_t *counters = (const uint64_t *) &_metrics;
+    uint64_t *snapshot = (uint64_t *) metrics;
+    for ( size_t index = 0; index < sizeof( nxai_socket_metrics_t ) / sizeof( uint64_t ); index++ ) {
+        snapshot[index] = __atomic_load_n( &counters[index], __ATOMIC_RELAXED );
+    }
+}
+
+bool nxai_socket_receive_on_connection( int connection_fd, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length ) {
+    return nxai_socket_receive_with_fds_on_connection( connection_fd, allocated_buffer_size, message_input_buffer, message_length, NULL, NULL );
+}
+
+bool nxai_socket_receive_with_fds_on_connection( int connection_fd, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length, int *received_fds, size_t *num_received_fds ) {
 
     size_t num_read_cumulitive = 0;
     ssize_t num_read;
     const int flags = MSG_NOSIGNAL;
 
-    // Set timeout for socket receive
-    setsockopt( connection_fd, SOL_SOCKET, SO_RCVTIMEO, (const char *) &tv, sizeof tv );
-    // Read message header, which tells us the full message length
-    num_read = recv( connection_fd, message_length, MESSAGE_HEADER_LENGTH, flags );
+    int header_fds[NXAI_SOCKET_MAX_FDS];
+    size_t num_header_fds = 0;
+    size_t fds_capacity = 0;
+    if ( received_fds != NULL && num_received_fds != NULL ) {
+        fds_capacity = *num_received_fds < NXAI_SOCKET_MAX_FDS ? *num_received_fds : NXAI_SOCKET_MAX_FDS;
+        *num_received_fds = 0;
+    }
+
+    // Read message header, which tells us the full message length.
+    // File descriptors sent with the message arrive together with the header.
+    union {
+        char buffer[CMSG_SPACE( NXAI_SOCKET_MAX_FDS * sizeof( int ) )];
+        struct cmsghdr align;
+    } control;
+    struct iovec header_iov = { .iov_base = message_length, .iov_len = MESSAGE_HEADER_LENGTH };
+    struct msghdr header_message = { .msg_iov = &header_iov, .msg_iovlen = 1, .msg_control = control.buffer, .msg_controllen = sizeof( control.buffer ) };
+    num_read = recvmsg( connection_fd, &header_message, flags | MSG_CMSG_CLOEXEC );
+    if ( num_read > 0 ) {
+        num_header_fds = _collect_fds( &header_message, header_fds, fds_capacity );
+    }
     if ( (size_t) num_read != MESSAGE_HEADER_LENGTH ) {
-        return;
+        // Peer closed the connection, timed out or sent a short header
+        _metrics_count_receive_failure( num_read == -1 ? errno : 0, num_read > 0 );
+        _close_fds( header_fds, num_header_fds );
+        *message_length = 0;
+        return false;
+    }
+
+    if ( _message_size_allowed( *message_length ) == false ) {
+        _close_fds( header_fds, num_header_fds );
+        *message_length = 0;
+        return false;
     }
 
     // Allocate space for incoming message.
@@ -117,9 +413,13 @@ void nxai_socket_receive_on_connection( int connection_fd, size_t *allocated_buf
         char *new_pointer = realloc( ( *message_input_buffer ), ( *message_length ) * sizeof( char ) );
         if ( new_pointer == NULL ) {
             printf( "Error: Could not allocate buffer with length: %d. Ignoring message.\n", ( *message_length ) );
-            return;
+            _metrics_count_receive_failure( ENOMEM, true );
+            _close_fds( header_fds, num_header_fds );
+            *message_length = 0;
+            return false;
         }
         // Reallocation succesful
+        _metrics_add( &_metrics.buffer_reallocations, 1 );
         *allocated_buffer_size = *message_length;
         *message_input_buffer = new_pointer;
     }
@@ -127,151 +427,2554 @@ void nxai_socket_receive_on_connection( int connection_fd, size_t *allocated_buf
     // Read at most read_buffer_size bytes from the socket into read_buffer,
     // then copy into read_buffer. Reset read count
     num_read_cumulitive = 0;
-    while ( ( num_read = recv( connection_fd, ( *message_input_buffer ) + num_read_cumulitive, ( *message_length ) - num_read_cumulitive, flags ) ) > 0 ) {
+    while ( num_read_cumulitive < *message_length && ( num_read = recv( connection_fd, ( *message_input_buffer ) + num_read_cumulitive, ( *message_length ) - num_read_cumulitive, flags ) ) > 0 ) {
         num_read_cumulitive += (size_t) num_read;
-        if ( num_read_cumulitive >= *message_length ) {
-            // Full message received. Stop reading.
-            break;
-        }
     }
+    int receive_error = num_read == -1 ? errno : 0;
     if ( num_read == -1 ) {
         printf( "Warning: Error when receiving socket message!\n" );
     }
-}
-
-int nxai_socket_await_message( int socket_fd, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length ) {
-
-    // Wait for incoming connection
-    int connection_fd = accept( socket_fd, NULL, NULL );
+    if ( num_read_cumulitive < *message_length ) {
+        // Connection dropped halfway through the message
+        _metrics_count_receive_failure( receive_error, true );
+        _close_fds( header_fds, num_header_fds );
+        *message_length = 0;
+        return false;
+    }
 
-    nxai_socket_receive_on_connection( connection_fd, allocated_buffer_size, message_input_buffer, message_length );
+    if ( num_header_fds > 0 ) {
+        memcpy( received_fds, header_fds, num_header_fds * sizeof( int ) );
+        *num_received_fds = num_header_fds;
+    }
 
-    return connection_fd;
+    _metrics_count_received( *message_length );
+    return true;
 }
 
 /**
- * @brief Listen on socket for incoming messages
+ * @brief Waits until a socket is ready for the given poll events, or until the deadline passes.
  *
+ * @param deadline_us Absolute deadline as returned by `nxai_monotonic_timestamp_us`, `NO_DEADLINE` waits forever.
+ * @return true if the socket is ready, false if the deadline passed or polling failed.
  */
-void nxai_socket_start_listener( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int ) ) {
-
-    // Create socket
-    int socket_fd = nxai_socket_create_listener( socket_path );
-    if ( socket_fd == -1 ) {
-        printf( "Error: Failed to create listening socket.\n" );
-        return;
+static bool _wait_until( int connection_fd, short events, uint64_t deadline_us ) {
+    struct pollfd poll_fd = { .fd = connection_fd, .events = events };
+    while ( true ) {
+        struct timespec timeout;
+        struct timespec *timeout_pointer = &timeout;
+        if ( deadline_us == NO_DEADLINE ) {
+            timeout_pointer = NULL;
+        } else {
+            uint64_t now_us = nxai_monotonic_timestamp_us();
+            uint64_t remaining_us = deadline_us > now_us ? deadline_us - now_us : 0;
+            timeout.tv_sec = (time_t) ( remaining_us / 1000000 );
+            timeout.tv_nsec = (long) ( remaining_us % 1000000 ) * 1000;
+        }
+        int result = ppoll( &poll_fd, 1, timeout_pointer, NULL );
+        if ( result == -1 && errno == EINTR ) {
+            continue;
+        }
+        if ( result == 0 ) {
+            errno = ETIMEDOUT;
+        }
+        return result == 1;
     }
+}
 
-    uint32_t message_length;
-
-    // Buffer for input message
-    char *message_input_buffer = NULL;
-    size_t allocated_buffer_size = 0;
-
-    // Listen in a loop
-    while ( nxai_socket_interrupt_signal == 0 ) {
-
-        int connection_fd = nxai_socket_await_message( socket_fd, &allocated_buffer_size, &message_input_buffer, &message_length );
+/**
+ * @brief Turns the send or receive timeout of a socket into a deadline, for sends and receives that
+ * wait several times but should not take longer than the timeout in total.
+ *
+ * @return The deadline, or `NO_DEADLINE` if the socket has no timeout.
+ */
+static uint64_t _socket_deadline( int connection_fd, int timeout_option ) {
+    // The socket timeout can be set per socket, zero means wait forever
+    struct timeval socket_timeout = tv;
+    socklen_t option_length = sizeof( socket_timeout );
+    getsockopt( connection_fd, SOL_SOCKET, timeout_option, &socket_timeout, &option_length );
+    if ( socket_timeout.tv_sec == 0 && socket_timeout.tv_usec == 0 ) {
+        return NO_DEADLINE;
+    }
+    return nxai_monotonic_timestamp_us() + (uint64_t) socket_timeout.tv_sec * 1000000 + (uint64_t) socket_timeout.tv_usec;
+}
 
-        if ( connection_fd == -1 ) {
-            // Socket likely timed out, start waiting again ( effectively checking for interrupt signal )
+/**
+ * @brief Receives exactly `length` bytes without blocking past the deadline.
+ */
+static bool _receive_until( int connection_fd, char *buffer, size_t length, uint64_t deadline_us ) {
+    size_t num_read_cumulative = 0;
+    while ( num_read_cumulative < length ) {
+        ssize_t num_read = recv( connection_fd, buffer + num_read_cumulative, length - num_read_cumulative, MSG_NOSIGNAL | MSG_DONTWAIT );
+        if ( num_read > 0 ) {
+            num_read_cumulative += (size_t) num_read;
+            continue;
+        }
+        if ( num_read == 0 ) {
+            // Peer closed the connection
+            errno = ECONNRESET;
+            return false;
+        }
+        if ( errno == EINTR ) {
             continue;
         }
+        if ( ( errno != EAGAIN && errno != EWOULDBLOCK ) || _wait_until( connection_fd, POLLIN, deadline_us ) == false ) {
+            return false;
+        }
+    }
+    return true;
+}
 
-        if ( nxai_socket_interrupt_signal == false ) {
-            callback_function( message_input_buffer, message_length, connection_fd );
+bool nxai_socket_receive_with_deadline_on_connection( int connection_fd, uint64_t deadline_us, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length ) {
+
+    // Until the message starts arriving the connection stays usable, so report that separately
+    *message_length = 0;
+    if ( _wait_until( connection_fd, POLLIN, deadline_us ) == false ) {
+        _metrics_count_receive_failure( errno, false );
+        if ( errno == ETIMEDOUT ) {
+            errno = EAGAIN;
         }
+        return false;
+    }
+
+    uint32_t incoming_length;
+    if ( _receive_until( connection_fd, (char *) &incoming_length, MESSAGE_HEADER_LENGTH, deadline_us ) == false ) {
+        _metrics_count_receive_failure( errno, false );
+        return false;
+    }
+    if ( _message_size_allowed( incoming_length ) == false ) {
+        return false;
+    }
 
-        // Close connection
-        if ( close( connection_fd ) == -1 ) {
-            printf( "Warning: Sender socket close error!\n" );
+    if ( incoming_length > *allocated_buffer_size || *message_input_buffer == NULL ) {
+        char *new_pointer = realloc( *message_input_buffer, incoming_length > 0 ? incoming_length : 1 );
+        if ( new_pointer == NULL ) {
+            printf( "Error: Could not allocate buffer with length: %u. Ignoring message.\n", incoming_length );
+            _metrics_count_receive_failure( ENOMEM, true );
+            errno = ENOMEM;
+            return false;
         }
+        _metrics_add( &_metrics.buffer_reallocations, 1 );
+        *allocated_buffer_size = incoming_length;
+        *message_input_buffer = new_pointer;
     }
-    free( message_input_buffer );
 
-    // Unlink socket file so it can be used again
-    unlink( socket_path );
+    if ( _receive_until( connection_fd, *message_input_buffer, incoming_length, deadline_us ) == false ) {
+        _metrics_count_receive_failure( errno, true );
+        return false;
+    }
+    *message_length = incoming_length;
+    _metrics_count_received( incoming_length );
+    return true;
 }
 
-int32_t nxai_socket_connect( const char *socket_path ) {
-    // Create new socket
-    int32_t socket_fd = socket( AF_UNIX, SOCK_STREAM, 0 );
-    if ( socket_fd < 0 ) {
-        printf( "Warning: socket() creation failed\n" );
-        close( socket_fd );
-        return -1;
+bool nxai_socket_poll_connection( int connection_fd, uint32_t timeout_us ) {
+    return _wait_until( connection_fd, POLLIN, nxai_monotonic_timestamp_us() + timeout_us );
+}
+
+/**
+ * @brief Bookkeeping stored in front of every pool buffer. Padded so the buffer stays maximally aligned.
+ */
+typedef union {
+    struct {
+        size_t size_class;
+        size_t capacity;
+    };
+    max_align_t align;
+} _buffer_header_t;
+
+struct nxai_socket_buffer_pool {
+    pthread_mutex_t lock;
+    // Released buffers per size class, linked through their first bytes
+    char *free_lists[BUFFER_POOL_NUM_CLASSES];
+    size_t cached_bytes;
+    size_t max_cached_bytes;
+};
+
+static inline _buffer_header_t *_buffer_header( const char *buffer ) {
+    return (_buffer_header_t *) ( buffer - sizeof( _buffer_header_t ) );
+}
+
+nxai_socket_buffer_pool_t *nxai_socket_buffer_pool_create( size_t max_cached_bytes ) {
+    nxai_socket_buffer_pool_t *pool = calloc( 1, sizeof( nxai_socket_buffer_pool_t ) );
+    if ( pool == NULL ) {
+        return NULL;
     }
-    setsockopt( socket_fd, SOL_SOCKET, SO_SNDTIMEO, (const char *) &tv, sizeof tv );
-    setsockopt( socket_fd, SOL_SOCKET, SO_RCVTIMEO, (const char *) &tv, sizeof tv );
+    pthread_mutex_init( &pool->lock, NULL );
+    pool->max_cached_bytes = max_cached_bytes;
+    return pool;
+}
 
-    // Generate socket address
-    struct sockaddr_un addr;
-    memset( &addr, 0, sizeof( struct sockaddr_un ) );
-    addr.sun_family = AF_UNIX;
+void nxai_socket_buffer_pool_destroy( nxai_socket_buffer_pool_t *pool ) {
+    if ( pool == NULL ) {
+        return;
+    }
+    for ( size_t size_class = 0; size_class < BUFFER_POOL_NUM_CLASSES; size_class++ ) {
+        char *buffer = pool->free_lists[size_class];
+        while ( buffer != NULL ) {
+            char *next;
+            memcpy( &next, buffer, sizeof( next ) );
+            free( _buffer_header( buffer ) );
+            buffer = next;
+        }
+    }
+    pthread_mutex_destroy( &pool->lock );
+    free( pool );
+}
 
-    strncpy( addr.sun_path, socket_path, sizeof( addr.sun_path ) - 1 );
+char *nxai_socket_buffer_acquire( nxai_socket_buffer_pool_t *pool, size_t size ) {
+    // Find the smallest size class that fits, which also has room for the free list link
+    size_t size_class = 0;
+    size_t capacity = (size_t) 1 << BUFFER_POOL_MIN_CLASS_SHIFT;
+    while ( capacity < size && size_class < BUFFER_POOL_UNCACHED ) {
+        size_class++;
+        capacity <<= 1;
+    }
+    if ( size_class == BUFFER_POOL_UNCACHED ) {
+        capacity = size;
+    }
 
-    // Check if we have access to socket
-    if ( access( socket_path, F_OK ) != 0 ) {
-        printf( "Warning: access to socket failed at %s\n", socket_path );
-        close( socket_fd );
-        return -1;
+    if ( pool != NULL && size_class != BUFFER_POOL_UNCACHED ) {
+        pthread_mutex_lock( &pool->lock );
+        char *buffer = pool->free_lists[size_class];
+        if ( buffer != NULL ) {
+            memcpy( &pool->free_lists[size_class], buffer, sizeof( char * ) );
+            pool->cached_bytes -= capacity;
+        }
+        pthread_mutex_unlock( &pool->lock );
+        if ( buffer != NULL ) {
+            return buffer;
+        }
     }
 
-    // Connect to socket
-    if ( connect( socket_fd, (struct sockaddr *) &addr,
-                  sizeof( struct sockaddr_un ) )
-         == -1 ) {
-        printf( "Warning: connect to socket [%s] failed: %s\n", socket_path, strerror( errno ) );
-        close( socket_fd );
-        return -1;
+    _buffer_header_t *header = malloc( sizeof( _buffer_header_t ) + capacity );
+    if ( header == NULL ) {
+        return NULL;
     }
+    header->size_class = pool != NULL ? size_class : BUFFER_POOL_UNCACHED;
+    header->capacity = capacity;
+    return (char *) ( header + 1 );
+}
 
-    return socket_fd;
+size_t nxai_socket_buffer_capacity( const char *buffer ) {
+    return _buffer_header( buffer )->capacity;
 }
 
-void nxai_socket_send( const char *socket_path, const char *message_to_send, uint32_t message_length ) {
+void nxai_socket_buffer_release( nxai_socket_buffer_pool_t *pool, char *buffer ) {
+    if ( buffer == NULL ) {
+        return;
+    }
+    _buffer_header_t *header = _buffer_header( buffer );
+    if ( pool != NULL && header->size_class != BUFFER_POOL_UNCACHED ) {
+        pthread_mutex_lock( &pool->lock );
+        bool cache = pool->cached_bytes + header->capacity <= pool->max_cached_bytes;
+        if ( cache ) {
+            memcpy( buffer, &pool->free_lists[header->size_class], sizeof( char * ) );
+            pool->free_lists[header->size_class] = buffer;
+            pool->cached_bytes += header->capacity;
+        }
+        pthread_mutex_unlock( &pool->lock );
+        if ( cache ) {
+            return;
+        }
+    }
+    free( header );
+}
 
-    int32_t connection_fd = nxai_socket_connect( socket_path );
+bool nxai_socket_receive_pooled_on_connection( int connection_fd, nxai_socket_buffer_pool_t *pool, char **message, uint32_t *message_length ) {
 
-    // Send message to newly created socket
-    nxai_socket_send_to_connection( connection_fd, message_to_send, message_length );
+    *message = NULL;
+    *message_length = 0;
 
-    // Close socket
-    close( connection_fd );
-}
+    uint32_t incoming_length;
+    ssize_t num_read = recv( connection_fd, &incoming_length, MESSAGE_HEADER_LENGTH, MSG_NOSIGNAL | MSG_WAITALL );
+    if ( num_read != MESSAGE_HEADER_LENGTH ) {
+        // Peer closed the connection, timed out or sent a short header
+        _metrics_count_receive_failure( num_read == -1 ? errno : 0, num_read > 0 );
+        return false;
+    }
+    if ( _message_size_allowed( incoming_length ) == false ) {
+        return false;
+    }
 
-bool nxai_socket_send_to_connection( const int connection_fd, const char *message_to_send, uint32_t message_length ) {
+    char *buffer = nxai_socket_buffer_acquire( pool, incoming_length );
+    if ( buffer == NULL ) {
+        printf( "Error: Could not allocate buffer with length: %u. Ignoring message.\n", incoming_length );
+        _metrics_count_receive_failure( ENOMEM, true );
+        return false;
+    }
 
-    setsockopt( connection_fd, SOL_SOCKET, SO_SNDTIMEO, (const char *) &tv, sizeof tv );
+    size_t num_read_cumulative = 0;
+    while ( num_read_cumulative < incoming_length && ( num_read = recv( connection_fd, buffer + num_read_cumulative, incoming_length - num_read_cumulative, MSG_NOSIGNAL ) ) > 0 ) {
+        num_read_cumulative += (size_t) num_read;
+    }
+    int receive_error = num_read == -1 ? errno : 0;
+    if ( num_read == -1 ) {
+        printf( "Warning: Error when receiving socket message!\n" );
+    }
+    if ( num_read_cumulative < incoming_length ) {
+        // Connection dropped halfway through the message
+        _metrics_count_receive_failure( receive_error, true );
+        nxai_socket_buffer_release( pool, buffer );
+        return false;
+    }
+
+    *message = buffer;
+    *message_length = incoming_length;
+    _metrics_count_received( incoming_length );
+    return true;
+}
 
-    const int32_t flags = MSG_NOSIGNAL;
+bool nxai_socket_receive_streaming_on_connection( int connection_fd, nxai_socket_chunk_callback_t chunk_callback, void *user_data, uint32_t *message_length ) {
 
-    size_t header_sent_total = 0;
-    // Send header
-    for ( ssize_t sent_now = 0; header_sent_total < sizeof( message_length ); header_sent_total += (size_t) sent_now ) {
-        sent_now = send( connection_fd, ( (char *) &message_length ) + header_sent_total, sizeof( message_length ) - header_sent_total, flags );
-        if ( sent_now == -1 ) {
-            printf( "Warning: send to socket failed\n" );
-            return false;
-        }
+    *message_length = 0;
+
+    uint32_t incoming_length;
+    ssize_t num_read = recv( connection_fd, &incoming_length, MESSAGE_HEADER_LENGTH, MSG_NOSIGNAL | MSG_WAITALL );
+    if ( num_read != MESSAGE_HEADER_LENGTH ) {
+        // Peer closed the connection, timed out or sent a short header
+        _metrics_count_receive_failure( num_read == -1 ? errno : 0, num_read > 0 );
+        return false;
     }
 
-    if ( header_sent_total != sizeof( message_length ) ) {
-        printf( "Warning: Could not send header!\n" );
+    // Only a single chunk is held in memory, however large the message is
+    size_t chunk_size = incoming_length < STREAM_CHUNK_SIZE ? incoming_length : STREAM_CHUNK_SIZE;
+    char *chunk = malloc( chunk_size > 0 ? chunk_size : 1 );
+    if ( chunk == NULL ) {
+        printf( "Error: Could not allocate buffer with length: %zu. Ignoring message.\n", chunk_size );
+        _metrics_count_receive_failure( ENOMEM, true );
+        errno = ENOMEM;
         return false;
     }
 
-    // Send message
-    size_t sent_total = 0;
-    for ( ssize_t sent_now = 0; sent_total < message_length; sent_total += (size_t) sent_now ) {
-        sent_now = send( connection_fd, ( (char *) message_to_send ) + sent_total,
-                         message_length - sent_total, flags );
-        if ( sent_now == -1 ) {
-            printf( "Warning: send to socket failed\n" );
+    uint32_t offset = 0;
+    while ( offset < incoming_length ) {
+        // Fill the chunk before handing it over, so the callback sees few large pieces
+        uint32_t chunk_length = incoming_length - offset < chunk_size ? incoming_length - offset : (uint32_t) chunk_size;
+        uint32_t chunk_received = 0;
+        while ( chunk_received < chunk_length && ( num_read = recv( connection_fd, chunk + chunk_received, chunk_length - chunk_received, MSG_NOSIGNAL ) ) > 0 ) {
+            chunk_received += (uint32_t) num_read;
+        }
+        if ( chunk_received < chunk_length ) {
+            // Connection dropped halfway through the message
+            _metrics_count_receive_failure( num_read == -1 ? errno : 0, true );
+            printf( "Warning: Error when receiving socket message!\n" );
+            free( chunk );
+            return false;
+        }
+        if ( chunk_callback( chunk, chunk_length, offset, incoming_length, user_data ) == false ) {
+            // The rest of the message is still unread
+            _metrics_count_receive_failure( 0, true );
+            free( chunk );
+            errno = ECANCELED;
             return false;
         }
+        offset += chunk_length;
     }
+    free( chunk );
 
+    *message_length = incoming_length;
+    _metrics_count_received( incoming_length );
     return true;
 }
+
+int nxai_socket_await_message( int socket_fd, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length ) {
+
+    // Wait for incoming connection
+    int connection_fd = accept( socket_fd, NULL, NULL );
+
+    nxai_socket_receive_on_connection( connection_fd, allocated_buffer_size, message_input_buffer, message_length );
+
+    return connection_fd;
+}
+
+static void _create_interrupt_event( void ) {
+    _interrupt_event_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if ( _interrupt_event_fd == -1 ) {
+        printf( "Warning: Could not create listener interrupt event: %s\n", strerror( errno ) );
+    }
+}
+
+static int _get_interrupt_event( void ) {
+    pthread_once( &_interrupt_event_once, _create_interrupt_event );
+    return _interrupt_event_fd;
+}
+
+void nxai_socket_interrupt_listeners( void ) {
+    nxai_socket_interrupt_signal = true;
+    int event_fd = _get_interrupt_event();
+    if ( event_fd != -1 ) {
+        uint64_t increment = 1;
+        if ( write( event_fd, &increment, sizeof( increment ) ) == -1 && errno != EAGAIN ) {
+            printf( "Warning: Could not signal listener interrupt event: %s\n", strerror( errno ) );
+        }
+    }
+}
+
+/**
+ * @brief Takes the first queued item whose connection is not being handled by another worker.
+ *
+ * Must be called with the pool lock held.
+ *
+ * @return true if an item was taken.
+ */
+static bool _listener_pool_take( _listener_pool_t *pool, _listener_work_item_t *item ) {
+    for ( size_t index = 0; index < pool->count; index++ ) {
+        int connection_fd = pool->items[index].connection_fd;
+        bool connection_busy = false;
+        for ( size_t worker = 0; worker < pool->num_workers && connection_busy == false; worker++ ) {
+            connection_busy = pool->workers[worker].active_connection_fd == connection_fd;
+        }
+        if ( connection_busy == true ) {
+            continue;
+        }
+        *item = pool->items[index];
+        memmove( &pool->items[index], &pool->items[index + 1], ( pool->count - index - 1 ) * sizeof( _listener_work_item_t ) );
+        pool->count--;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Records how long after accepting a connection its first callback starts.
+ *
+ * Callbacks of a connection never run concurrently, so the connection itself needs no lock.
+ *
+ * @return The start time of the callback.
+ */
+static uint64_t _listener_callback_started( _listener_connection_t *connection ) {
+    uint64_t started_us = nxai_monotonic_timestamp_us();
+    if ( connection->callback_started == false ) {
+        connection->callback_started = true;
+        _metrics_record_duration( _metrics.accept_to_callback_us, connection->accepted_us, started_us );
+    }
+    return started_us;
+}
+
+static void *_listener_worker_run( void *argument ) {
+    _listener_worker_t *worker = argument;
+    _listener_pool_t *pool = worker->pool;
+    _listener_work_item_t item;
+
+    pthread_mutex_lock( &pool->lock );
+    while ( true ) {
+        if ( _listener_pool_take( pool, &item ) == false ) {
+            if ( pool->stopping == true && pool->count == 0 ) {
+                break;
+            }
+            pthread_cond_wait( &pool->work_available, &pool->lock );
+            continue;
+        }
+        worker->active_connection_fd = item.connection_fd;
+        pthread_cond_signal( &pool->not_full );
+        pthread_mutex_unlock( &pool->lock );
+
+        if ( item.message == NULL ) {
+            // All earlier messages of this connection are handled, safe to close now
+            if ( close( item.connection_fd ) == -1 ) {
+                printf( "Warning: Sender socket close error!\n" );
+            }
+            free( item.connection );
+        } else {
+            if ( nxai_socket_interrupt_signal == false ) {
+                uint64_t started_us = _listener_callback_started( item.connection );
+                pool->callback_function( item.message, item.message_length, item.connection_fd );
+                _metrics_record_duration( _metrics.callback_duration_us, started_us, nxai_monotonic_timestamp_us() );
+            }
+            free( item.message );
+        }
+
+        pthread_mutex_lock( &pool->lock );
+        if ( item.message != NULL ) {
+            _listener_connection_t *connection = item.connection;
+            connection->num_queued--;
+            if ( connection->paused == true && connection->resume_pending == false && connection->num_queued < pool->pipeline_depth ) {
+                // Have the event loop read from this connection again
+                connection->resume_pending = true;
+                connection->resume_next = pool->resume_list;
+                pool->resume_list = connection;
+                uint64_t increment = 1;
+                if ( write( pool->resume_event_fd, &increment, sizeof( increment ) ) == -1 ) {
+                    printf( "Warning: Could not wake listener to resume connection.\n" );
+                }
+            }
+        }
+        worker->active_connection_fd = -1;
+        // Messages of this connection may have been skipped by idle workers
+        pthread_cond_broadcast( &pool->work_available );
+    }
+    pthread_mutex_unlock( &pool->lock );
+    return NULL;
+}
+
+/**
+ * @brief Queues an item for the workers, blocking while the queue is full.
+ *
+ * Blocking here stops the event loop from reading, so busy workers apply backpressure to senders.
+ */
+static void _listener_pool_push( _listener_pool_t *pool, _listener_work_item_t item ) {
+    pthread_mutex_lock( &pool->lock );
+    while ( pool->count == pool->capacity ) {
+        pthread_cond_wait( &pool->not_full, &pool->lock );
+    }
+    pool->items[pool->count++] = item;
+    if ( item.message != NULL ) {
+        item.connection->num_queued++;
+    }
+    pthread_cond_signal( &pool->work_available );
+    pthread_mutex_unlock( &pool->lock );
+}
+
+/**
+ * @brief Stops the workers once all queued items are handled and frees the pool.
+ */
+static void _listener_pool_destroy( _listener_pool_t *pool ) {
+    pthread_mutex_lock( &pool->lock );
+    pool->stopping = true;
+    pthread_cond_broadcast( &pool->work_available );
+    pthread_mutex_unlock( &pool->lock );
+    for ( size_t index = 0; index < pool->num_workers; index++ ) {
+        pthread_join( pool->workers[index].thread, NULL );
+    }
+    pthread_mutex_destroy( &pool->lock );
+    pthread_cond_destroy( &pool->work_available );
+    pthread_cond_destroy( &pool->not_full );
+    if ( pool->resume_event_fd != -1 ) {
+        close( pool->resume_event_fd );
+    }
+    free( pool->workers );
+    free( pool->items );
+    free( pool );
+}
+
+static _listener_pool_t *_listener_pool_create( void ( *callback_function )( const char *, uint32_t, int ), size_t num_workers, size_t queue_length, size_t pipeline_depth ) {
+    _listener_pool_t *pool = calloc( 1, sizeof( _listener_pool_t ) );
+    if ( pool == NULL ) {
+        return NULL;
+    }
+    pool->items = malloc( queue_length * sizeof( _listener_work_item_t ) );
+    pool->workers = calloc( num_workers, sizeof( _listener_worker_t ) );
+    pool->resume_event_fd = pipeline_depth > 0 ? eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) : -1;
+    if ( pool->items == NULL || pool->workers == NULL || ( pipeline_depth > 0 && pool->resume_event_fd == -1 ) ) {
+        if ( pool->resume_event_fd != -1 ) {
+            close( pool->resume_event_fd );
+        }
+        free( pool->items );
+        free( pool->workers );
+        free( pool );
+        return NULL;
+    }
+    pool->capacity = queue_length;
+    pool->callback_function = callback_function;
+    pool->pipeline_depth = pipeline_depth;
+    pthread_mutex_init( &pool->lock, NULL );
+    pthread_cond_init( &pool->work_available, NULL );
+    pthread_cond_init( &pool->not_full, NULL );
+
+    for ( size_t index = 0; index < num_workers; index++ ) {
+        _listener_worker_t *worker = &pool->workers[index];
+        worker->active_connection_fd = -1;
+        worker->pool = pool;
+        if ( pthread_create( &worker->thread, NULL, _listener_worker_run, worker ) != 0 ) {
+            printf( "Error: Could not start listener worker %zu.\n", index );
+            _listener_pool_destroy( pool );
+            return NULL;
+        }
+        pool->num_workers++;
+    }
+    return pool;
+}
+
+static _listener_connection_t *_listener_connection_open( int connection_fd ) {
+    _listener_connection_t *connection = calloc( 1, sizeof( _listener_connection_t ) );
+    if ( connection == NULL ) {
+        return NULL;
+    }
+    connection->connection_fd = connection_fd;
+    connection->accepted_us = nxai_monotonic_timestamp_us();
+    _metrics_add( &_metrics.connections_accepted, 1 );
+    return connection;
+}
+
+static void _listener_connection_close( _listener_t *listener, _listener_connection_t *connection ) {
+    _metrics_add( &_metrics.connections_closed, 1 );
+    if ( connection->header_received > 0 || connection->backlog_length > 0 ) {
+        // Closed while a message was arriving, or before paused messages were read
+        _metrics_add( &_metrics.partial_reads, 1 );
+    }
+    if ( listener->pool != NULL ) {
+        // Messages of this connection may still be queued, let a worker close it after them.
+        // The descriptor stays open until then, so its number can not be reused for a new connection.
+        // The worker also frees the connection, queued messages refer to it.
+        _close_fds( connection->pending_fds, connection->num_pending_fds );
+        free( connection->message_buffer );
+        connection->message_buffer = NULL;
+        free( connection->backlog );
+        connection->backlog = NULL;
+        _listener_work_item_t item = { .connection_fd = connection->connection_fd, .connection = connection, .message = NULL };
+        _listener_pool_push( listener->pool, item );
+        return;
+    }
+    if ( close( connection->connection_fd ) == -1 ) {
+        printf( "Warning: Sender socket close error!\n" );
+    }
+    _close_fds( connection->pending_fds, connection->num_pending_fds );
+    free( connection->message_buffer );
+    free( connection );
+}
+
+/**
+ * @brief Adds descriptors to those pending for the message being received on a connection.
+ */
+static void _listener_connection_add_fds( _listener_connection_t *connection, const int *fds, size_t *num_fds ) {
+    for ( size_t index = 0; index < *num_fds; index++ ) {
+        if ( connection->num_pending_fds < NXAI_SOCKET_MAX_FDS ) {
+            connection->pending_fds[connection->num_pending_fds++] = fds[index];
+        } else {
+            close( fds[index] );
+        }
+    }
+    *num_fds = 0;
+}
+
+/**
+ * @brief Hands a complete message to the callback, either directly or through the connection's worker.
+ */
+static void _listener_dispatch( _listener_t *listener, _listener_connection_t *connection, const char *message, uint32_t message_length ) {
+    _metrics_count_received( message_length );
+
+    // Descriptors received with this message are owned by the fd callback, otherwise nobody wants them
+    size_t num_fds = connection->num_pending_fds;
+    connection->num_pending_fds = 0;
+    if ( listener->fd_callback_function != NULL ) {
+        uint64_t started_us = _listener_callback_started( connection );
+        listener->fd_callback_function( message, message_length, connection->connection_fd, connection->pending_fds, num_fds );
+        _metrics_record_duration( _metrics.callback_duration_us, started_us, nxai_monotonic_timestamp_us() );
+        return;
+    }
+    _close_fds( connection->pending_fds, num_fds );
+
+    if ( listener->message_handler != NULL ) {
+        listener->message_handler( listener->handler_context, connection, message, message_length );
+        return;
+    }
+
+    if ( listener->pool == NULL ) {
+        uint64_t started_us = _listener_callback_started( connection );
+        if ( listener->split_batches == true ) {
+            size_t offset = 0;
+            const char *record;
+            uint32_t record_length;
+            while ( nxai_socket_batch_next( message, message_length, &offset, &record, &record_length ) == true ) {
+                listener->callback_function( record, record_length, connection->connection_fd );
+            }
+        } else {
+            listener->callback_function( message, message_length, connection->connection_fd );
+        }
+        _metrics_record_duration( _metrics.callback_duration_us, started_us, nxai_monotonic_timestamp_us() );
+        return;
+    }
+
+    _listener_work_item_t item = { .connection_fd = connection->connection_fd, .connection = connection, .message_length = message_length };
+    if ( message == connection->message_buffer ) {
+        // Hand the reassembly buffer over to the worker instead of copying it
+        item.message = connection->message_buffer;
+        connection->message_buffer = NULL;
+        connection->allocated_buffer_size = 0;
+    } else {
+        item.message = malloc( message_length > 0 ? message_length : 1 );
+        if ( item.message == NULL ) {
+            printf( "Error: Could not allocate buffer with length: %u. Ignoring message.\n", message_length );
+            return;
+        }
+        memcpy( item.message, message, message_length );
+    }
+    _listener_pool_push( listener->pool, item );
+}
+
+/**
+ * @brief Pauses reading from a connection that has as many messages queued as the pipeline depth.
+ *
+ * @return true if the connection was paused.
+ */
+static bool _listener_pause_connection( _listener_pool_t *pool, _listener_connection_t *connection ) {
+    if ( pool == NULL || pool->pipeline_depth == 0 ) {
+        return false;
+    }
+    pthread_mutex_lock( &pool->lock );
+    if ( connection->num_queued >= pool->pipeline_depth ) {
+        connection->paused = true;
+    }
+    bool paused = connection->paused;
+    pthread_mutex_unlock( &pool->lock );
+    return paused;
+}
+
+/**
+ * @brief Checks whether reading from a connection is paused, see `_listener_pause_connection`.
+ */
+static bool _listener_connection_paused( _listener_pool_t *pool, _listener_connection_t *connection ) {
+    if ( pool == NULL || pool->pipeline_depth == 0 ) {
+        return false;
+    }
+    pthread_mutex_lock( &pool->lock );
+    bool paused = connection->paused;
+    pthread_mutex_unlock( &pool->lock );
+    return paused;
+}
+
+/**
+ * @brief Keeps received data that can not be consumed while reading from the connection is paused.
+ */
+static bool _listener_connection_stash( _listener_connection_t *connection, const char *data, size_t length ) {
+    if ( length == 0 ) {
+        return true;
+    }
+    char *new_pointer = realloc( connection->backlog, connection->backlog_length + length );
+    if ( new_pointer == NULL ) {
+        printf( "Error: Could not allocate buffer with length: %zu. Closing connection.\n", connection->backlog_length + length );
+        _metrics_count_receive_failure( ENOMEM, false );
+        return false;
+    }
+    memcpy( new_pointer + connection->backlog_length, data, length );
+    connection->backlog = new_pointer;
+    connection->backlog_length += length;
+    return true;
+}
+
+/**
+ * @brief Reads available packets from a non-blocking SOCK_SEQPACKET connection and dispatches them.
+ *
+ * Every packet is one complete message, so there is no header and no reassembly. Packets are at most
+ * `NXAI_SOCKET_MAX_PACKET_SIZE` bytes, so each one is received with a single `recvmsg` into the staging buffer.
+ *
+ * @return false if the connection was closed by the peer or failed and should be closed, true otherwise.
+ */
+static bool _listener_connection_read_packets( _listener_t *listener, _listener_connection_t *connection, char *staging_buffer ) {
+
+    for ( int read_round = 0; read_round < LISTENER_READS_PER_EVENT; read_round++ ) {
+        union {
+            char buffer[CMSG_SPACE( NXAI_SOCKET_MAX_FDS * sizeof( int ) )];
+            struct cmsghdr align;
+        } control;
+        struct iovec packet_iov = { .iov_base = staging_buffer, .iov_len = NXAI_SOCKET_MAX_PACKET_SIZE };
+        struct msghdr packet_message = { .msg_iov = &packet_iov, .msg_iovlen = 1, .msg_control = control.buffer, .msg_controllen = sizeof( control.buffer ) };
+        ssize_t num_read = recvmsg( connection->connection_fd, &packet_message, MSG_NOSIGNAL | MSG_DONTWAIT | MSG_CMSG_CLOEXEC );
+
+        if ( num_read == 0 ) {
+            // Peer closed the connection, empty packets are never sent
+            return false;
+        }
+        if ( num_read == -1 ) {
+            if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+                return true;
+            }
+            if ( errno == EINTR ) {
+                continue;
+            }
+            _metrics_count_receive_failure( errno, false );
+            printf( "Warning: Error when receiving socket message: %s\n", strerror( errno ) );
+            return false;
+        }
+
+        size_t num_read_fds = 0;
+        int read_fds[NXAI_SOCKET_MAX_FDS];
+        if ( packet_message.msg_controllen > 0 ) {
+            num_read_fds = _collect_fds( &packet_message, read_fds, NXAI_SOCKET_MAX_FDS );
+        }
+        if ( packet_message.msg_flags & MSG_TRUNC ) {
+            printf( "Warning: Received packet larger than %d bytes, ignoring message.\n", NXAI_SOCKET_MAX_PACKET_SIZE );
+            _metrics_count_receive_failure( 0, true );
+            _close_fds( read_fds, num_read_fds );
+            continue;
+        }
+        _listener_connection_add_fds( connection, read_fds, &num_read_fds );
+        _listener_dispatch( listener, connection, staging_buffer, (uint32_t) num_read );
+    }
+
+    return true;
+}
+
+/**
+ * @brief Consumes received stream bytes, which may hold any number of (partial) messages.
+ *
+ * Messages that lie entirely in the data are dispatched without copying, partial messages are
+ * reassembled in the connection's own buffer. Descriptors received with the data are attached to the
+ * message that contains its last byte.
+ *
+ * @return false if the connection should be closed, true otherwise.
+ */
+static bool _listener_connection_consume( _listener_t *listener, _listener_connection_t *connection, char *data, size_t length, int *read_fds, size_t *num_read_fds ) {
+
+    size_t offset = 0;
+    while ( offset < length ) {
+        size_t available = length - offset;
+
+        if ( connection->header_received < MESSAGE_HEADER_LENGTH ) {
+            if ( connection->header_received == 0 && available >= MESSAGE_HEADER_LENGTH ) {
+                uint32_t message_length;
+                memcpy( &message_length, data + offset, MESSAGE_HEADER_LENGTH );
+                if ( _message_size_allowed( message_length ) == false ) {
+                    _close_fds( read_fds, *num_read_fds );
+                    return false;
+                }
+                if ( available - MESSAGE_HEADER_LENGTH >= message_length ) {
+                    // Complete message in received data, dispatch without copying
+                    if ( offset + MESSAGE_HEADER_LENGTH + message_length == length ) {
+                        _listener_connection_add_fds( connection, read_fds, num_read_fds );
+                    }
+                    _listener_dispatch( listener, connection, data + offset + MESSAGE_HEADER_LENGTH, message_length );
+                    offset += MESSAGE_HEADER_LENGTH + message_length;
+                    if ( _listener_pause_connection( listener->pool, connection ) == true ) {
+                        break;
+                    }
+                    continue;
+                }
+            }
+            // Collect (the rest of) the header
+            size_t header_bytes = MESSAGE_HEADER_LENGTH - connection->header_received;
+            if ( header_bytes > available ) {
+                header_bytes = available;
+            }
+            memcpy( ( (char *) &connection->message_length ) + connection->header_received, data + offset, header_bytes );
+            connection->header_received += header_bytes;
+            offset += header_bytes;
+            if ( connection->header_received < MESSAGE_HEADER_LENGTH ) {
+                break;
+            }
+            if ( _message_size_allowed( connection->message_length ) == false ) {
+                _close_fds( read_fds, *num_read_fds );
+                return false;
+            }
+            // Header complete, make room for the body
+            connection->message_received = 0;
+            if ( connection->message_length > connection->allocated_buffer_size || connection->message_buffer == NULL ) {
+                char *new_pointer = realloc( connection->message_buffer, connection->message_length > 0 ? connection->message_length : 1 );
+                if ( new_pointer == NULL ) {
+                    printf( "Error: Could not allocate buffer with length: %u. Closing connection.\n", connection->message_length );
+                    _metrics_count_receive_failure( ENOMEM, false );
+                    _close_fds( read_fds, *num_read_fds );
+                    return false;
+                }
+                _metrics_add( &_metrics.buffer_reallocations, 1 );
+                connection->message_buffer = new_pointer;
+                connection->allocated_buffer_size = connection->message_length;
+            }
+            available = length - offset;
+        }
+
+        // Collect body bytes
+        size_t body_bytes = connection->message_length - connection->message_received;
+        if ( body_bytes > available ) {
+            body_bytes = available;
+        }
+        memcpy( connection->message_buffer + connection->message_received, data + offset, body_bytes );
+        connection->message_received += body_bytes;
+        offset += body_bytes;
+        if ( connection->message_received == connection->message_length ) {
+            if ( offset == length ) {
+                _listener_connection_add_fds( connection, read_fds, num_read_fds );
+            }
+            _listener_dispatch( listener, connection, connection->message_buffer, connection->message_length );
+            connection->header_received = 0;
+            if ( _listener_pause_connection( listener->pool, connection ) == true ) {
+                break;
+            }
+        }
+    }
+    if ( offset < length ) {
+        // Reading paused, the descriptors went to a message that was already dispatched or are unwanted
+        _close_fds( read_fds, *num_read_fds );
+        *num_read_fds = 0;
+        return _listener_connection_stash( connection, data + offset, length - offset );
+    }
+    // Message that ends this data is still incomplete, keep the descriptors until it is
+    _listener_connection_add_fds( connection, read_fds, num_read_fds );
+    return true;
+}
+
+/**
+ * @brief Reads available data from a non-blocking connection and dispatches every complete message.
+ *
+ * Data is read in large chunks into a staging buffer, so several small messages can arrive in a single
+ * `recv`. Messages that lie entirely in the staging buffer are dispatched without copying. Partial
+ * messages are reassembled in the connection's own buffer across calls. Large message bodies are read
+ * directly into the message buffer.
+ *
+ * @return false if the connection was closed by the peer or failed and should be closed, true otherwise.
+ */
+static bool _listener_connection_read( _listener_t *listener, _listener_connection_t *connection, char *staging_buffer ) {
+
+    for ( int read_round = 0; read_round < LISTENER_READS_PER_EVENT; read_round++ ) {
+
+        if ( _listener_connection_paused( listener->pool, connection ) == true ) {
+            return true;
+        }
+
+        ssize_t num_read;
+        int read_fds[NXAI_SOCKET_MAX_FDS];
+        size_t num_read_fds = 0;
+        size_t body_remaining = connection->message_length - connection->message_received;
+        if ( connection->header_received == MESSAGE_HEADER_LENGTH && body_remaining >= LISTENER_STAGING_BUFFER_SIZE ) {
+            // Large body, read straight into the message buffer
+            num_read = recv( connection->connection_fd, connection->message_buffer + connection->message_received, body_remaining, MSG_NOSIGNAL | MSG_DONTWAIT );
+            if ( num_read > 0 ) {
+                connection->message_received += (size_t) num_read;
+                if ( connection->message_received == connection->message_length ) {
+                    _listener_dispatch( listener, connection, connection->message_buffer, connection->message_length );
+                    connection->header_received = 0;
+                    if ( _listener_pause_connection( listener->pool, connection ) == true ) {
+                        return true;
+                    }
+                }
+                continue;
+            }
+        } else {
+            // A read ends right after the data that carried descriptors, so they belong to the message
+            // that contains the last byte of this read
+            union {
+                char buffer[CMSG_SPACE( NXAI_SOCKET_MAX_FDS * sizeof( int ) )];
+                struct cmsghdr align;
+            } control;
+            struct iovec staging_iov = { .iov_base = staging_buffer, .iov_len = LISTENER_STAGING_BUFFER_SIZE };
+            struct msghdr staging_message = { .msg_iov = &staging_iov, .msg_iovlen = 1, .msg_control = control.buffer, .msg_controllen = sizeof( control.buffer ) };
+            num_read = recvmsg( connection->connection_fd, &staging_message, MSG_NOSIGNAL | MSG_DONTWAIT | MSG_CMSG_CLOEXEC );
+            if ( num_read > 0 && staging_message.msg_controllen > 0 ) {
+                num_read_fds = _collect_fds( &staging_message, read_fds, NXAI_SOCKET_MAX_FDS );
+            }
+        }
+
+        if ( num_read == 0 ) {
+            // Peer closed the connection
+            return false;
+        }
+        if ( num_read == -1 ) {
+            if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+                return true;
+            }
+            if ( errno == EINTR ) {
+                continue;
+            }
+            _metrics_count_receive_failure( errno, false );
+            printf( "Warning: Error when receiving socket message: %s\n", strerror( errno ) );
+            return false;
+        }
+
+        if ( !_listener_connection_consume( listener, connection, staging_buffer, (size_t) num_read, read_fds, &num_read_fds ) ) {
+            return false;
+        }
+    }
+
+    // More data may be pending, epoll is level triggered so we will be woken again
+    return true;
+}
+
+/**
+ * @brief Takes the connections that workers have caught up with, so they can be read again.
+ */
+static _listener_connection_t *_listener_take_resumed( _listener_pool_t *pool ) {
+    uint64_t count;
+    if ( read( pool->resume_event_fd, &count, sizeof( count ) ) == -1 && errno != EAGAIN ) {
+        printf( "Warning: Could not read listener resume event.\n" );
+    }
+    pthread_mutex_lock( &pool->lock );
+    _listener_connection_t *resumed = pool->resume_list;
+    pool->resume_list = NULL;
+    for ( _listener_connection_t *connection = resumed; connection != NULL; connection = connection->resume_next ) {
+        connection->paused = false;
+        connection->resume_pending = false;
+    }
+    pthread_mutex_unlock( &pool->lock );
+    return resumed;
+}
+
+/**
+ * @brief Runs the listener event loop until interrupted.
+ *
+ * Connections are non-blocking and multiplexed with epoll, so a slow sender does not stall other
+ * connections. Connections are kept open after the callback returns, and closed when the peer closes them.
+ */
+static void _listener_run( const char *socket_path, _listener_t *listener ) {
+
+    // Create socket
+    int socket_fd = nxai_socket_create_listener_with_type( socket_path, listener->socket_type );
+    if ( socket_fd == -1 ) {
+        printf( "Error: Failed to create listening socket.\n" );
+        return;
+    }
+
+    int epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    char *staging_buffer = malloc( LISTENER_STAGING_BUFFER_SIZE );
+    if ( epoll_fd == -1 || staging_buffer == NULL ) {
+        printf( "Error: Failed to set up listener event loop.\n" );
+        if ( epoll_fd != -1 ) {
+            close( epoll_fd );
+        }
+        free( staging_buffer );
+        close( socket_fd );
+        unlink( socket_path );
+        return;
+    }
+
+    // Listening socket has a NULL pointer, the interrupt event has a marker pointer
+    fcntl( socket_fd, F_SETFL, fcntl( socket_fd, F_GETFL ) | O_NONBLOCK );
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl( epoll_fd, EPOLL_CTL_ADD, socket_fd, &event );
+    int interrupt_fd = _get_interrupt_event();
+    if ( interrupt_fd != -1 ) {
+        event.data.ptr = &_interrupt_event_fd;
+        epoll_ctl( epoll_fd, EPOLL_CTL_ADD, interrupt_fd, &event );
+    }
+    // Workers wake the loop through the pool's event when paused connections can be read again
+    if ( listener->pool != NULL && listener->pool->resume_event_fd != -1 ) {
+        event.data.ptr = listener->pool;
+        epoll_ctl( epoll_fd, EPOLL_CTL_ADD, listener->pool->resume_event_fd, &event );
+    }
+
+    // Keep track of open connections so they can be closed on shutdown
+    size_t num_connections = 0;
+    size_t allocated_connections = 16;
+    _listener_connection_t **connections = malloc( allocated_connections * sizeof( _listener_connection_t * ) );
+
+    struct epoll_event events[LISTENER_MAX_EVENTS];
+
+    // Listen in a loop
+    while ( nxai_socket_interrupt_signal == false && connections != NULL ) {
+
+        // Without an interrupt event, fall back to checking the interrupt signal periodically
+        int num_events = epoll_wait( epoll_fd, events, LISTENER_MAX_EVENTS, interrupt_fd == -1 ? tv.tv_sec * 1000 : -1 );
+        if ( num_events == -1 && errno != EINTR ) {
+            printf( "Error: Listener event loop failed: %s\n", strerror( errno ) );
+            break;
+        }
+
+        for ( int index = 0; index < num_events && nxai_socket_interrupt_signal == false; index++ ) {
+
+            if ( events[index].data.ptr == &_interrupt_event_fd ) {
+                // Interrupt signal was reset since the event was raised, consume the event and continue
+                uint64_t count;
+                if ( read( interrupt_fd, &count, sizeof( count ) ) == -1 && errno != EAGAIN ) {
+                    printf( "Warning: Could not read listener interrupt event.\n" );
+                }
+                continue;
+            }
+
+            if ( listener->pool != NULL && events[index].data.ptr == listener->pool ) {
+                _listener_connection_t *connection = _listener_take_resumed( listener->pool );
+                while ( connection != NULL ) {
+                    _listener_connection_t *next = connection->resume_next;
+                    // Data received before pausing comes first, it may pause the connection again
+                    char *backlog = connection->backlog;
+                    size_t backlog_length = connection->backlog_length;
+                    connection->backlog = NULL;
+                    connection->backlog_length = 0;
+                    size_t num_backlog_fds = 0;
+                    bool keep_open = _listener_connection_consume( listener, connection, backlog, backlog_length, NULL, &num_backlog_fds );
+                    free( backlog );
+                    if ( keep_open == false ) {
+                        connections[connection->table_index] = connections[--num_connections];
+                        connections[connection->table_index]->table_index = connection->table_index;
+                        _listener_connection_close( listener, connection );
+                    } else if ( _listener_connection_paused( listener->pool, connection ) == false ) {
+                        struct epoll_event connection_event = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = connection };
+                        epoll_ctl( epoll_fd, EPOLL_CTL_ADD, connection->connection_fd, &connection_event );
+                    }
+                    connection = next;
+                }
+                continue;
+            }
+
+            if ( events[index].data.ptr == NULL ) {
+                // Accept all pending connections
+                int connection_fd;
+                while ( ( connection_fd = accept4( socket_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC ) ) != -1 ) {
+                    if ( num_connections == allocated_connections ) {
+                        _listener_connection_t **new_pointer = realloc( connections, 2 * allocated_connections * sizeof( _listener_connection_t * ) );
+                        if ( new_pointer == NULL ) {
+                            printf( "Warning: Could not grow listener connection table. Dropping connection.\n" );
+                            close( connection_fd );
+                            continue;
+                        }
+                        connections = new_pointer;
+                        allocated_connections *= 2;
+                    }
+                    _listener_connection_t *connection = _listener_connection_open( connection_fd );
+                    if ( connection == NULL ) {
+                        close( connection_fd );
+                        continue;
+                    }
+                    struct epoll_event connection_event = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = connection };
+                    if ( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, connection_fd, &connection_event ) == -1 ) {
+                        _listener_connection_close( listener, connection );
+                        continue;
+                    }
+                    connection->table_index = num_connections;
+                    connections[num_connections++] = connection;
+                }
+                continue;
+            }
+
+            _listener_connection_t *connection = events[index].data.ptr;
+            if ( _listener_pause_connection( listener->pool, connection ) == true ) {
+                // Stop watching until a worker catches up, it would keep reporting the pending data
+                epoll_ctl( epoll_fd, EPOLL_CTL_DEL, connection->connection_fd, NULL );
+                continue;
+            }
+            bool keep_open = true;
+            if ( events[index].events & ( EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR ) ) {
+                // Read first, the peer may have sent a message before hanging up
+                if ( listener->socket_type == SOCK_SEQPACKET ) {
+                    keep_open = _listener_connection_read_packets( listener, connection, staging_buffer );
+                } else {
+                    keep_open = _listener_connection_read( listener, connection, staging_buffer );
+                }
+            }
+            if ( keep_open == true && _listener_connection_paused( listener->pool, connection ) == true ) {
+                epoll_ctl( epoll_fd, EPOLL_CTL_DEL, connection->connection_fd, NULL );
+            }
+            if ( keep_open == false ) {
+                epoll_ctl( epoll_fd, EPOLL_CTL_DEL, connection->connection_fd, NULL );
+                // Fill the gap in the connection table with the last entry
+                connections[connection->table_index] = connections[--num_connections];
+                connections[connection->table_index]->table_index = connection->table_index;
+                _listener_connection_close( listener, connection );
+            }
+        }
+    }
+
+    // Close remaining connections and the listening socket
+    for ( size_t index = 0; index < num_connections; index++ ) {
+        _listener_connection_close( listener, connections[index] );
+    }
+    free( connections );
+    free( staging_buffer );
+    close( epoll_fd );
+    close( socket_fd );
+
+    // Unlink socket file so it can be used again
+    unlink( socket_path );
+}
+
+#ifdef NXAI_SOCKET_IO_URING
+
+// Ring sizes and receive buffers provided to the kernel for multishot receive
+#define LISTENER_URING_ENTRIES 256
+#define LISTENER_URING_BUFFERS 32
+#define LISTENER_URING_BUFFER_SIZE LISTENER_STAGING_BUFFER_SIZE
+// Wait before retrying a submission the kernel had no resources for
+#define LISTENER_URING_BACKOFF_US 1000
+
+// User data of the listening socket and interrupt event operations, connections use their pointer
+#define LISTENER_URING_ACCEPT 1
+#define LISTENER_URING_INTERRUPT 2
+#define LISTENER_URING_IGNORE 3
+
+typedef struct {
+    int ring_fd;
+    // Submission queue
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned to_submit;
+    // Completion queue
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    // Mappings
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    // Provided receive buffers
+    struct io_uring_buf_ring *buffer_ring;
+    size_t buffer_ring_size;
+    char *buffers;
+    uint16_t buffer_tail;
+    // Operations that still have to complete
+    size_t in_flight;
+    bool multishot_accept;
+    bool multishot_receive;
+} _listener_uring_t;
+
+static void _listener_uring_destroy( _listener_uring_t *ring ) {
+    if ( ring->buffer_ring != NULL ) {
+        munmap( ring->buffer_ring, ring->buffer_ring_size );
+    }
+    free( ring->buffers );
+    if ( ring->sqes != NULL ) {
+        munmap( ring->sqes, ring->sqes_size );
+    }
+    if ( ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring ) {
+        munmap( ring->cq_ring, ring->cq_ring_size );
+    }
+    if ( ring->sq_ring != NULL ) {
+        munmap( ring->sq_ring, ring->sq_ring_size );
+    }
+    if ( ring->ring_fd != -1 ) {
+        close( ring->ring_fd );
+    }
+}
+
+/**
+ * @brief Hands a receive buffer (back) to the kernel.
+ */
+static void _listener_uring_provide_buffer( _listener_uring_t *ring, uint16_t buffer_id ) {
+    struct io_uring_buf *buffer = &ring->buffer_ring->bufs[ring->buffer_tail & ( LISTENER_URING_BUFFERS - 1 )];
+    buffer->addr = (uint64_t) (uintptr_t) ( ring->buffers + (size_t) buffer_id * LISTENER_URING_BUFFER_SIZE );
+    buffer->len = LISTENER_URING_BUFFER_SIZE;
+    buffer->bid = buffer_id;
+    ring->buffer_tail++;
+    __atomic_store_n( &ring->buffer_ring->tail, ring->buffer_tail, __ATOMIC_RELEASE );
+}
+
+/**
+ * @brief Sets up an io_uring instance with a ring of provided receive buffers.
+ *
+ * @return false if io_uring or provided buffer rings are not supported by the kernel.
+ */
+static bool _listener_uring_create( _listener_uring_t *ring ) {
+    memset( ring, 0, sizeof( *ring ) );
+    ring->multishot_accept = true;
+    ring->multishot_receive = true;
+
+    struct io_uring_params params;
+    memset( &params, 0, sizeof( params ) );
+    ring->ring_fd = (int) syscall( __NR_io_uring_setup, LISTENER_URING_ENTRIES, &params );
+    if ( ring->ring_fd == -1 ) {
+        return false;
+    }
+
+    // Map submission and completion queues, which may share one mapping
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+    if ( params.features & IORING_FEAT_SINGLE_MMAP ) {
+        if ( ring->cq_ring_size > ring->sq_ring_size ) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap( NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING );
+    if ( ring->sq_ring == MAP_FAILED ) {
+        ring->sq_ring = NULL;
+        _listener_uring_destroy( ring );
+        return false;
+    }
+    if ( params.features & IORING_FEAT_SINGLE_MMAP ) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap( NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING );
+        if ( ring->cq_ring == MAP_FAILED ) {
+            ring->cq_ring = NULL;
+            _listener_uring_destroy( ring );
+            return false;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof( struct io_uring_sqe );
+    ring->sqes = mmap( NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES );
+    if ( ring->sqes == MAP_FAILED ) {
+        ring->sqes = NULL;
+        _listener_uring_destroy( ring );
+        return false;
+    }
+
+    char *sq_ring = ring->sq_ring;
+    ring->sq_head = (unsigned *) ( sq_ring + params.sq_off.head );
+    ring->sq_tail = (unsigned *) ( sq_ring + params.sq_off.tail );
+    ring->sq_mask = *(unsigned *) ( sq_ring + params.sq_off.ring_mask );
+    ring->sq_entries = params.sq_entries;
+    ring->sq_array = (unsigned *) ( sq_ring + params.sq_off.array );
+    char *cq_ring = ring->cq_ring;
+    ring->cq_head = (unsigned *) ( cq_ring + params.cq_off.head );
+    ring->cq_tail = (unsigned *) ( cq_ring + params.cq_off.tail );
+    ring->cq_mask = *(unsigned *) ( cq_ring + params.cq_off.ring_mask );
+    ring->cqes = (struct io_uring_cqe *) ( cq_ring + params.cq_off.cqes );
+
+    // Register the provided buffer ring, the kernel picks a buffer when data arrives
+    ring->buffer_ring_size = LISTENER_URING_BUFFERS * sizeof( struct io_uring_buf );
+    ring->buffer_ring = mmap( NULL, ring->buffer_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    ring->buffers = malloc( (size_t) LISTENER_URING_BUFFERS * LISTENER_URING_BUFFER_SIZE );
+    if ( ring->buffer_ring == MAP_FAILED || ring->buffers == NULL ) {
+        if ( ring->buffer_ring == MAP_FAILED ) {
+            ring->buffer_ring = NULL;
+        }
+        _listener_uring_destroy( ring );
+        return false;
+    }
+    struct io_uring_buf_reg registration;
+    memset( &registration, 0, sizeof( registration ) );
+    registration.ring_addr = (uint64_t) (uintptr_t) ring->buffer_ring;
+    registration.ring_entries = LISTENER_URING_BUFFERS;
+    registration.bgid = 0;
+    if ( syscall( __NR_io_uring_register, ring->ring_fd, IORING_REGISTER_PBUF_RING, &registration, 1 ) == -1 ) {
+        _listener_uring_destroy( ring );
+        return false;
+    }
+    for ( uint16_t buffer_id = 0; buffer_id < LISTENER_URING_BUFFERS; buffer_id++ ) {
+        _listener_uring_provide_buffer( ring, buffer_id );
+    }
+    return true;
+}
+
+/**
+ * @brief Submits queued operations and waits for at least `min_complete` completions.
+ */
+static bool _listener_uring_enter( _listener_uring_t *ring, unsigned min_complete ) {
+    while ( true ) {
+        long submitted = syscall( __NR_io_uring_enter, ring->ring_fd, ring->to_submit, min_complete, min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0 );
+        if ( submitted >= 0 ) {
+            ring->to_submit -= (unsigned) submitted;
+            return true;
+        }
+        if ( errno != EINTR && errno != EAGAIN && errno != EBUSY ) {
+            printf( "Error: io_uring submission failed: %s\n", strerror( errno ) );
+            return false;
+        }
+        if ( errno != EINTR && *ring->cq_head != __atomic_load_n( ring->cq_tail, __ATOMIC_ACQUIRE ) ) {
+            // Completion queue is full, reap completions first
+            return true;
+        }
+        if ( errno != EINTR ) {
+            // The kernel is short of resources with nothing to reap, retrying right away would spin
+            usleep( LISTENER_URING_BACKOFF_US );
+        }
+    }
+}
+
+/**
+ * @brief Queues an operation. Entries are only read by the kernel on submission, so the caller fills
+ * in the returned entry after it is queued.
+ */
+static struct io_uring_sqe *_listener_uring_queue( _listener_uring_t *ring, uint8_t opcode, int fd, uint64_t user_data ) {
+    unsigned tail = *ring->sq_tail;
+    if ( tail - __atomic_load_n( ring->sq_head, __ATOMIC_ACQUIRE ) == ring->sq_entries ) {
+        _listener_uring_enter( ring, 0 );
+    }
+    unsigned index = tail & ring->sq_mask;
+    struct io_uring_sqe *entry = &ring->sqes[index];
+    memset( entry, 0, sizeof( *entry ) );
+    entry->opcode = opcode;
+    entry->fd = fd;
+    entry->user_data = user_data;
+    ring->sq_array[index] = index;
+    __atomic_store_n( ring->sq_tail, tail + 1, __ATOMIC_RELEASE );
+    ring->to_submit++;
+    return entry;
+}
+
+static void _listener_uring_arm_accept( _listener_uring_t *ring, int socket_fd ) {
+    struct io_uring_sqe *entry = _listener_uring_queue( ring, IORING_OP_ACCEPT, socket_fd, LISTENER_URING_ACCEPT );
+    entry->accept_flags = SOCK_CLOEXEC;
+    entry->ioprio = ring->multishot_accept ? IORING_ACCEPT_MULTISHOT : 0;
+    ring->in_flight++;
+}
+
+static void _listener_uring_arm_interrupt( _listener_uring_t *ring, int interrupt_fd ) {
+    struct io_uring_sqe *entry = _listener_uring_queue( ring, IORING_OP_POLL_ADD, interrupt_fd, LISTENER_URING_INTERRUPT );
+    entry->poll32_events = POLLIN;
+    ring->in_flight++;
+}
+
+static void _listener_uring_arm_receive( _listener_uring_t *ring, _listener_connection_t *connection ) {
+    struct io_uring_sqe *entry = _listener_uring_queue( ring, IORING_OP_RECV, connection->connection_fd, (uint64_t) (uintptr_t) connection );
+    entry->flags = IOSQE_BUFFER_SELECT;
+    entry->buf_group = 0;
+    if ( ring->multishot_receive ) {
+        entry->ioprio = IORING_RECV_MULTISHOT;
+    } else {
+        entry->len = LISTENER_URING_BUFFER_SIZE;
+    }
+    ring->in_flight++;
+}
+
+/**
+ * @brief Runs the listener event loop on io_uring until interrupted.
+ *
+ * Connections are accepted with a multishot accept and read with multishot receives into buffers the
+ * kernel picks from a shared pool, so a busy connection needs a single submission instead of a
+ * readiness notification and a `recv` call per read. Kernels without multishot operations get them
+ * re-submitted one at a time. Messages are reassembled and dispatched like in `_listener_run`.
+ *
+ * Receives into provided buffers carry no ancillary data, so listeners that take file descriptors are
+ * not run here.
+ *
+ * @return false if io_uring is not available, in which case nothing was started.
+ */
+static bool _listener_run_uring( const char *socket_path, _listener_t *listener ) {
+
+    if ( listener->fd_callback_function != NULL ) {
+        return false;
+    }
+
+    // Shutting down depends on the interrupt event to wake up the ring
+    int interrupt_fd = _get_interrupt_event();
+    _listener_uring_t ring;
+    if ( interrupt_fd == -1 || _listener_uring_create( &ring ) == false ) {
+        return false;
+    }
+
+    int socket_fd = nxai_socket_create_listener_with_type( socket_path, SOCK_STREAM );
+    if ( socket_fd == -1 ) {
+        printf( "Error: Failed to create listening socket.\n" );
+        _listener_uring_destroy( &ring );
+        return true;
+    }
+
+    // Keep track of open connections so they can be shut down when the listener stops
+    size_t num_connections = 0;
+    size_t allocated_connections = 16;
+    _listener_connection_t **connections = malloc( allocated_connections * sizeof( _listener_connection_t * ) );
+
+    _listener_uring_arm_accept( &ring, socket_fd );
+    _listener_uring_arm_interrupt( &ring, interrupt_fd );
+    bool running = connections != NULL;
+    bool stopped = false;
+
+    // After stopping, keep reaping until the kernel is done with all operations and buffers
+    while ( ring.in_flight > 0 ) {
+
+        if ( running && nxai_socket_interrupt_signal ) {
+            running = false;
+        }
+        if ( running == false && stopped == false ) {
+            // Cancel accepting and waiting for the interrupt, shutting down connections completes their reads
+            stopped = true;
+            struct io_uring_sqe *entry = _listener_uring_queue( &ring, IORING_OP_ASYNC_CANCEL, -1, LISTENER_URING_IGNORE );
+            entry->addr = LISTENER_URING_ACCEPT;
+            entry = _listener_uring_queue( &ring, IORING_OP_ASYNC_CANCEL, -1, LISTENER_URING_IGNORE );
+            entry->addr = LISTENER_URING_INTERRUPT;
+            for ( size_t index = 0; index < num_connections; index++ ) {
+                connections[index]->closing = true;
+                shutdown( connections[index]->connection_fd, SHUT_RDWR );
+            }
+        }
+
+        if ( _listener_uring_enter( &ring, 1 ) == false ) {
+            break;
+        }
+
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n( ring.cq_tail, __ATOMIC_ACQUIRE );
+        for ( ; head != tail; head++ ) {
+            struct io_uring_cqe completion = ring.cqes[head & ring.cq_mask];
+            bool more = ( completion.flags & IORING_CQE_F_MORE ) != 0;
+
+            if ( completion.user_data == LISTENER_URING_IGNORE ) {
+                continue;
+            }
+
+            if ( completion.user_data == LISTENER_URING_INTERRUPT ) {
+                ring.in_flight--;
+                if ( nxai_socket_interrupt_signal ) {
+                    running = false;
+                } else if ( running && completion.res >= 0 ) {
+                    // Interrupt signal was reset since the event was raised, consume the event and continue
+                    uint64_t count;
+                    if ( read( interrupt_fd, &count, sizeof( count ) ) == -1 && errno != EAGAIN ) {
+                        printf( "Warning: Could not read listener interrupt event.\n" );
+                    }
+                    _listener_uring_arm_interrupt( &ring, interrupt_fd );
+                }
+                continue;
+            }
+
+            if ( completion.user_data == LISTENER_URING_ACCEPT ) {
+                if ( more == false ) {
+                    ring.in_flight--;
+                }
+                if ( completion.res >= 0 ) {
+                    int connection_fd = completion.res;
+                    _listener_connection_t *connection = NULL;
+                    if ( running && num_connections == allocated_connections ) {
+                        _listener_connection_t **new_pointer = realloc( connections, 2 * allocated_connections * sizeof( _listener_connection_t * ) );
+                        if ( new_pointer != NULL ) {
+                            connections = new_pointer;
+                            allocated_connections *= 2;
+                        }
+                    }
+                    if ( running && num_connections < allocated_connections ) {
+                        connection = _listener_connection_open( connection_fd );
+                    }
+                    if ( connection == NULL ) {
+                        close( connection_fd );
+                    } else {
+                        connection->table_index = num_connections;
+                        connections[num_connections++] = connection;
+                        _listener_uring_arm_receive( &ring, connection );
+                    }
+                } else if ( completion.res == -EINVAL && ring.multishot_accept && running ) {
+                    // Kernel does not support multishot accept
+                    ring.multishot_accept = false;
+                }
+                if ( more == false && running ) {
+                    _listener_uring_arm_accept( &ring, socket_fd );
+                }
+                continue;
+            }
+
+            _listener_connection_t *connection = (_listener_connection_t *) (uintptr_t) completion.user_data;
+            if ( completion.res > 0 ) {
+                // Data was received in one of the provided buffers, give it back once consumed
+                uint16_t buffer_id = (uint16_t) ( completion.flags >> IORING_CQE_BUFFER_SHIFT );
+                if ( connection->closing == false ) {
+                    size_t num_read_fds = 0;
+                    if ( _listener_connection_consume( listener, connection, ring.buffers + (size_t) buffer_id * LISTENER_URING_BUFFER_SIZE, (size_t) completion.res, NULL, &num_read_fds ) == false ) {
+                        connection->closing = true;
+                        shutdown( connection->connection_fd, SHUT_RDWR );
+                    }
+                }
+                _listener_uring_provide_buffer( &ring, buffer_id );
+            }
+            if ( more ) {
+                continue;
+            }
+
+            // Receive operation ended, re-submit it or close the connection
+            ring.in_flight--;
+            if ( completion.res == -EINVAL && ring.multishot_receive ) {
+                // Kernel does not support multishot receive
+                ring.multishot_receive = false;
+            } else if ( completion.res <= 0 && completion.res != -ENOBUFS ) {
+                // Peer closed the connection or it failed
+                if ( completion.res < 0 && completion.res != -ECONNRESET && connection->closing == false ) {
+                    _metrics_count_receive_failure( -completion.res, false );
+                    printf( "Warning: Error when receiving socket message: %s\n", strerror( -completion.res ) );
+                }
+                connection->closing = true;
+            }
+            if ( connection->closing == false && running ) {
+                _listener_uring_arm_receive( &ring, connection );
+                continue;
+            }
+            // Fill the gap in the connection table with the last entry
+            connections[connection->table_index] = connections[--num_connections];
+            connections[connection->table_index]->table_index = connection->table_index;
+            _listener_connection_close( listener, connection );
+        }
+        __atomic_store_n( ring.cq_head, head, __ATOMIC_RELEASE );
+    }
+
+    for ( size_t index = 0; index < num_connections; index++ ) {
+        _listener_connection_close( listener, connections[index] );
+    }
+    free( connections );
+    _listener_uring_destroy( &ring );
+    close( socket_fd );
+
+    // Unlink socket file so it can be used again
+    unlink( socket_path );
+    return true;
+}
+
+#endif
+
+void nxai_socket_start_listener( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int ) ) {
+    _listener_t listener = { .socket_type = SOCK_STREAM, .callback_function = callback_function };
+    _listener_run( socket_path, &listener );
+}
+
+void nxai_socket_start_packet_listener( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int ) ) {
+    _listener_t listener = { .socket_type = SOCK_SEQPACKET, .callback_function = callback_function };
+    _listener_run( socket_path, &listener );
+}
+
+void nxai_socket_start_batch_listener( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int ) ) {
+    _listener_t listener = { .socket_type = SOCK_STREAM, .callback_function = callback_function, .split_batches = true };
+    _listener_run( socket_path, &listener );
+}
+
+void nxai_socket_start_fd_listener( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int, const int *, size_t ) ) {
+    _listener_t listener = { .socket_type = SOCK_STREAM, .fd_callback_function = callback_function };
+    _listener_run( socket_path, &listener );
+}
+
+void nxai_socket_start_listener_pool( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int ), size_t num_workers, size_t queue_length ) {
+    if ( num_workers == 0 || queue_length == 0 ) {
+        printf( "Error: Listener worker pool needs at least one worker and one queue slot.\n" );
+        return;
+    }
+    _listener_t listener = { .socket_type = SOCK_STREAM, .callback_function = callback_function };
+    listener.pool = _listener_pool_create( callback_function, num_workers, queue_length, 0 );
+    if ( listener.pool == NULL ) {
+        printf( "Error: Failed to create listener worker pool.\n" );
+        return;
+    }
+    _listener_run( socket_path, &listener );
+    // Workers close the remaining connections after their queued messages
+    _listener_pool_destroy( listener.pool );
+}
+
+void nxai_socket_start_pipelined_listener( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int ), size_t num_workers, size_t queue_length, size_t pipeline_depth ) {
+    if ( num_workers == 0 || queue_length == 0 || pipeline_depth == 0 ) {
+        printf( "Error: Pipelined listener needs at least one worker, one queue slot and a pipeline depth of one.\n" );
+        return;
+    }
+    _listener_t listener = { .socket_type = SOCK_STREAM, .callback_function = callback_function };
+    listener.pool = _listener_pool_create( callback_function, num_workers, queue_length, pipeline_depth );
+    if ( listener.pool == NULL ) {
+        printf( "Error: Failed to create listener worker pool.\n" );
+        return;
+    }
+    _listener_run( socket_path, &listener );
+    // Workers close the remaining connections after their queued messages
+    _listener_pool_destroy( listener.pool );
+}
+
+void nxai_socket_start_uring_listener( const char *socket_path, void ( *callback_function )( const char *, uint32_t, int ) ) {
+    _listener_t listener = { .socket_type = SOCK_STREAM, .callback_function = callback_function };
+#ifdef NXAI_SOCKET_IO_URING
+    if ( _listener_run_uring( socket_path, &listener ) ) {
+        return;
+    }
+#endif
+    printf( "Warning: io_uring is not available, falling back to epoll listener.\n" );
+    _listener_run( socket_path, &listener );
+}
+
+int32_t nxai_socket_connect( const char *socket_path ) {
+    return nxai_socket_connect_with_type( socket_path, SOCK_STREAM );
+}
+
+/**
+ * @brief Connects to a socket, waiting at most `connect_timeout` when the listener's backlog is full.
+ */
+static int32_t _connect( const char *socket_path, int socket_type, const struct timeval *connect_timeout ) {
+    // Create new socket
+    int32_t socket_fd = socket( AF_UNIX, socket_type, 0 );
+    if ( socket_fd < 0 ) {
+        printf( "Warning: socket() creation failed\n" );
+        close( socket_fd );
+        return -1;
+    }
+    // Connecting waits up to the send timeout
+    setsockopt( socket_fd, SOL_SOCKET, SO_SNDTIMEO, (const char *) connect_timeout, sizeof( *connect_timeout ) );
+    setsockopt( socket_fd, SOL_SOCKET, SO_RCVTIMEO, (const char *) &tv, sizeof tv );
+
+    // Generate socket address
+    struct sockaddr_un addr;
+    memset( &addr, 0, sizeof( struct sockaddr_un ) );
+    addr.sun_family = AF_UNIX;
+
+    strncpy( addr.sun_path, socket_path, sizeof( addr.sun_path ) - 1 );
+
+    // Check if we have access to socket
+    if ( access( socket_path, F_OK ) != 0 ) {
+        printf( "Warning: access to socket failed at %s\n", socket_path );
+        close( socket_fd );
+        return -1;
+    }
+
+    // Connect to socket
+    if ( connect( socket_fd, (struct sockaddr *) &addr,
+                  sizeof( struct sockaddr_un ) )
+         == -1 ) {
+        printf( "Warning: connect to socket [%s] failed: %s\n", socket_path, strerror( errno ) );
+        close( socket_fd );
+        return -1;
+    }
+    if ( connect_timeout != &tv ) {
+        setsockopt( socket_fd, SOL_SOCKET, SO_SNDTIMEO, (const char *) &tv, sizeof tv );
+    }
+
+    return socket_fd;
+}
+
+int32_t nxai_socket_connect_with_type( const char *socket_path, int socket_type ) {
+    return _connect( socket_path, socket_type, &tv );
+}
+
+int32_t nxai_socket_connect_with_timeout( const char *socket_path, uint32_t timeout_ms ) {
+    // A zero timeout would wait forever
+    struct timeval connect_timeout = { .tv_sec = timeout_ms / 1000, .tv_usec = timeout_ms > 0 ? ( timeout_ms % 1000 ) * 1000 : 1 };
+    return _connect( socket_path, SOCK_STREAM, &connect_timeout );
+}
+
+void nxai_socket_set_default_timeout( uint32_t timeout_ms ) {
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = ( timeout_ms % 1000 ) * 1000;
+}
+
+void nxai_socket_set_max_message_size( uint32_t max_bytes ) {
+    max_message_size = max_bytes;
+}
+
+bool nxai_socket_set_timeout( int connection_fd, uint32_t timeout_ms ) {
+    struct timeval timeout = { .tv_sec = timeout_ms / 1000, .tv_usec = ( timeout_ms % 1000 ) * 1000 };
+    return setsockopt( connection_fd, SOL_SOCKET, SO_SNDTIMEO, (const char *) &timeout, sizeof timeout ) == 0
+           && setsockopt( connection_fd, SOL_SOCKET, SO_RCVTIMEO, (const char *) &timeout, sizeof timeout ) == 0;
+}
+
+void nxai_socket_send( const char *socket_path, const char *message_to_send, uint32_t message_length ) {
+
+    int32_t connection_fd = nxai_socket_connect( socket_path );
+
+    // Send message to newly created socket
+    nxai_socket_send_to_connection( connection_fd, message_to_send, message_length );
+
+    // Close socket
+    close( connection_fd );
+}
+
+/**
+ * @brief Checks whether a failed send should be retried.
+ *
+ * Sends do not block, so a send fails with EAGAIN when the socket buffer is full. In that case wait
+ * until the socket is writable again, up to the deadline.
+ */
+static bool _retry_send( int connection_fd, uint64_t deadline_us ) {
+    if ( errno == EINTR ) {
+        return true;
+    }
+    if ( errno != EAGAIN && errno != EWOULDBLOCK ) {
+        return false;
+    }
+    return _wait_until( connection_fd, POLLOUT, deadline_us );
+}
+
+/**
+ * @brief Sends all data described by a message header, continuing after partial sends.
+ *
+ * Control data is only sent with the first part, the iovec array of the message is modified.
+ * The socket is not blocked on, so the deadline is kept regardless of the socket timeout. Without a
+ * deadline the send timeout of the socket bounds the whole message, not each part of it.
+ */
+static bool _send_message_all( int connection_fd, struct msghdr *message, uint64_t deadline_us ) {
+    if ( deadline_us == NO_DEADLINE ) {
+        deadline_us = _socket_deadline( connection_fd, SO_SNDTIMEO );
+    }
+    while ( message->msg_iovlen > 0 ) {
+        ssize_t sent_now = sendmsg( connection_fd, message, MSG_NOSIGNAL | MSG_DONTWAIT );
+        if ( sent_now == -1 ) {
+            if ( _retry_send( connection_fd, deadline_us ) == true ) {
+                continue;
+            }
+            return false;
+        }
+        message->msg_control = NULL;
+        message->msg_controllen = 0;
+        // Skip what was sent
+        size_t sent_remaining = (size_t) sent_now;
+        while ( message->msg_iovlen > 0 && sent_remaining >= message->msg_iov[0].iov_len ) {
+            sent_remaining -= message->msg_iov[0].iov_len;
+            message->msg_iov++;
+            message->msg_iovlen--;
+        }
+        if ( message->msg_iovlen > 0 ) {
+            message->msg_iov[0].iov_base = (char *) message->msg_iov[0].iov_base + sent_remaining;
+            message->msg_iov[0].iov_len -= sent_remaining;
+        }
+    }
+    return true;
+}
+
+bool nxai_socket_send_with_fds_to_connection( const int connection_fd, const char *message_to_send, uint32_t message_length, const int *fds_to_send, size_t num_fds ) {
+    if ( num_fds > NXAI_SOCKET_MAX_FDS ) {
+        printf( "Warning: Can not send more than %d file descriptors with one message\n", NXAI_SOCKET_MAX_FDS );
+        return false;
+    }
+    if ( num_fds == 0 ) {
+        return nxai_socket_send_to_connection( connection_fd, message_to_send, message_length );
+    }
+
+    // Send header and message in one go with the descriptors attached, so the receiver gets them
+    // together with the message length
+    union {
+        char buffer[CMSG_SPACE( NXAI_SOCKET_MAX_FDS * sizeof( int ) )];
+        struct cmsghdr align;
+    } control;
+    memset( &control, 0, sizeof( control ) );
+    struct iovec message_iov[2] = {
+            { .iov_base = &message_length, .iov_len = MESSAGE_HEADER_LENGTH },
+            { .iov_base = (char *) message_to_send, .iov_len = message_length } };
+    struct msghdr header_message = { .msg_iov = message_iov, .msg_iovlen = 2, .msg_control = control.buffer, .msg_controllen = CMSG_SPACE( num_fds * sizeof( int ) ) };
+    struct cmsghdr *fd_control = CMSG_FIRSTHDR( &header_message );
+    fd_control->cmsg_level = SOL_SOCKET;
+    fd_control->cmsg_type = SCM_RIGHTS;
+    fd_control->cmsg_len = CMSG_LEN( num_fds * sizeof( int ) );
+    memcpy( CMSG_DATA( fd_control ), fds_to_send, num_fds * sizeof( int ) );
+
+    if ( _send_message_all( connection_fd, &header_message, NO_DEADLINE ) == false ) {
+        _metrics_count_send_failure();
+        printf( "Warning: send to socket failed\n" );
+        return false;
+    }
+
+    _metrics_count_sent( message_length );
+    return true;
+}
+
+/**
+ * @brief Sends a message made of several segments, see `nxai_socket_sendv_to_connection`.
+ */
+static bool _sendv_until( const int connection_fd, const struct iovec *segments, size_t num_segments, uint64_t deadline_us ) {
+    if ( num_segments > NXAI_SOCKET_MAX_SEGMENTS ) {
+        printf( "Warning: Can not send more than %d segments in one message\n", NXAI_SOCKET_MAX_SEGMENTS );
+        return false;
+    }
+
+    // Header and all segments go out in a single sendmsg
+    struct iovec message_iov[NXAI_SOCKET_MAX_SEGMENTS + 1];
+    size_t total_length = 0;
+    for ( size_t index = 0; index < num_segments; index++ ) {
+        message_iov[index + 1] = segments[index];
+        total_length += segments[index].iov_len;
+    }
+    if ( total_length > UINT32_MAX ) {
+        printf( "Warning: Message of %zu bytes is too large to send\n", total_length );
+        return false;
+    }
+    uint32_t message_length = (uint32_t) total_length;
+    message_iov[0].iov_base = &message_length;
+    message_iov[0].iov_len = MESSAGE_HEADER_LENGTH;
+
+    struct msghdr message = { .msg_iov = message_iov, .msg_iovlen = num_segments + 1 };
+    if ( _send_message_all( connection_fd, &message, deadline_us ) == false ) {
+        _metrics_count_send_failure();
+        // Missing a deadline is expected by the caller, do not warn about it
+        if ( deadline_us == NO_DEADLINE || errno != ETIMEDOUT ) {
+            printf( "Warning: send to socket failed\n" );
+        }
+        return false;
+    }
+
+    _metrics_count_sent( message_length );
+    return true;
+}
+
+bool nxai_socket_send_to_connection( const int connection_fd, const char *message_to_send, uint32_t message_length ) {
+    struct iovec segment = { .iov_base = (char *) message_to_send, .iov_len = message_length };
+    return nxai_socket_sendv_to_connection( connection_fd, &segment, 1 );
+}
+
+bool nxai_socket_sendv_to_connection( const int connection_fd, const struct iovec *segments, size_t num_segments ) {
+    return _sendv_until( connection_fd, segments, num_segments, NO_DEADLINE );
+}
+
+bool nxai_socket_send_with_deadline_to_connection( const int connection_fd, const char *message_to_send, uint32_t message_length, uint64_t deadline_us ) {
+    struct iovec segment = { .iov_base = (char *) message_to_send, .iov_len = message_length };
+    return _sendv_until( connection_fd, &segment, 1, deadline_us );
+}
+
+bool nxai_socket_send_packet_to_connection( const int connection_fd, const char *message_to_send, uint32_t message_length ) {
+    if ( message_length == 0 || message_length > NXAI_SOCKET_MAX_PACKET_SIZE ) {
+        printf( "Warning: Packet messages must be between 1 and %d bytes, not %u\n", NXAI_SOCKET_MAX_PACKET_SIZE, message_length );
+        return false;
+    }
+
+    // A packet is sent atomically, there are no partial sends
+    uint64_t deadline_us = _socket_deadline( connection_fd, SO_SNDTIMEO );
+    while ( send( connection_fd, message_to_send, message_length, MSG_NOSIGNAL | MSG_DONTWAIT ) == -1 ) {
+        if ( _retry_send( connection_fd, deadline_us ) == false ) {
+            _metrics_count_send_failure();
+            printf( "Warning: send to socket failed\n" );
+            return false;
+        }
+    }
+    _metrics_count_sent( message_length );
+    return true;
+}
+
+bool nxai_socket_receive_packet_on_connection( int connection_fd, size_t *allocated_buffer_size, char **message_input_buffer, uint32_t *message_length ) {
+    *message_length = 0;
+
+    // Any packet fits in a buffer of the maximum packet size, so it can be received in one call
+    if ( ( *allocated_buffer_size ) < NXAI_SOCKET_MAX_PACKET_SIZE || ( *message_input_buffer ) == NULL ) {
+        char *new_pointer = realloc( ( *message_input_buffer ), NXAI_SOCKET_MAX_PACKET_SIZE );
+        if ( new_pointer == NULL ) {
+            printf( "Error: Could not allocate buffer with length: %d. Ignoring message.\n", NXAI_SOCKET_MAX_PACKET_SIZE );
+            _metrics_count_receive_failure( ENOMEM, false );
+            return false;
+        }
+        _metrics_add( &_metrics.buffer_reallocations, 1 );
+        *allocated_buffer_size = NXAI_SOCKET_MAX_PACKET_SIZE;
+        *message_input_buffer = new_pointer;
+    }
+
+    ssize_t num_read;
+    do {
+        num_read = recv( connection_fd, *message_input_buffer, *allocated_buffer_size, MSG_NOSIGNAL | MSG_TRUNC );
+    } while ( num_read == -1 && errno == EINTR );
+    if ( num_read <= 0 ) {
+        // Peer closed the connection or the receive timed out
+        _metrics_count_receive_failure( num_read == -1 ? errno : 0, false );
+        return false;
+    }
+    if ( (size_t) num_read > *allocated_buffer_size ) {
+        printf( "Warning: Received packet of %zd bytes, larger than the buffer. Ignoring message.\n", num_read );
+        _metrics_count_receive_failure( 0, true );
+        return false;
+    }
+    *message_length = (uint32_t) num_read;
+    _metrics_count_received( *message_length );
+    return true;
+}
+
+bool nxai_socket_receivev_on_connection( int connection_fd, const struct iovec *segments, size_t num_segments, uint32_t *message_length ) {
+    if ( num_segments > NXAI_SOCKET_MAX_SEGMENTS ) {
+        printf( "Warning: Can not receive into more than %d segments\n", NXAI_SOCKET_MAX_SEGMENTS );
+        return false;
+    }
+
+    // The header is read separately, reading further could consume the start of the next message
+    ssize_t header_read = recv( connection_fd, message_length, MESSAGE_HEADER_LENGTH, MSG_NOSIGNAL | MSG_WAITALL );
+    if ( header_read != MESSAGE_HEADER_LENGTH ) {
+        _metrics_count_receive_failure( header_read == -1 ? errno : 0, header_read > 0 );
+        *message_length = 0;
+        return false;
+    }
+
+    // Limit the segments to the message length
+    struct iovec message_iov[NXAI_SOCKET_MAX_SEGMENTS];
+    size_t num_message_iov = 0;
+    size_t capacity_remaining = *message_length;
+    for ( size_t index = 0; index < num_segments && capacity_remaining > 0; index++ ) {
+        message_iov[num_message_iov] = segments[index];
+        if ( message_iov[num_message_iov].iov_len > capacity_remaining ) {
+            message_iov[num_message_iov].iov_len = capacity_remaining;
+        }
+        capacity_remaining -= message_iov[num_message_iov].iov_len;
+        num_message_iov++;
+    }
+
+    // Scatter the message into the segments
+    struct msghdr message = { .msg_iov = message_iov, .msg_iovlen = num_message_iov };
+    while ( message.msg_iovlen > 0 ) {
+        ssize_t num_read = recvmsg( connection_fd, &message, MSG_NOSIGNAL );
+        if ( num_read == -1 && errno == EINTR ) {
+            continue;
+        }
+        if ( num_read <= 0 ) {
+            _metrics_count_receive_failure( num_read == -1 ? errno : 0, true );
+            printf( "Warning: Error when receiving socket message!\n" );
+            *message_length = 0;
+            return false;
+        }
+        size_t read_remaining = (size_t) num_read;
+        while ( message.msg_iovlen > 0 && read_remaining >= message.msg_iov[0].iov_len ) {
+            read_remaining -= message.msg_iov[0].iov_len;
+            message.msg_iov++;
+            message.msg_iovlen--;
+        }
+        if ( message.msg_iovlen > 0 ) {
+            message.msg_iov[0].iov_base = (char *) message.msg_iov[0].iov_base + read_remaining;
+            message.msg_iov[0].iov_len -= read_remaining;
+        }
+    }
+
+    if ( capacity_remaining > 0 ) {
+        // Message is larger than the segments, discard the rest so the connection stays usable
+        printf( "Warning: Message of %u bytes does not fit in the receive segments, discarding %zu bytes\n", *message_length, capacity_remaining );
+        char discard_buffer[4096];
+        while ( capacity_remaining > 0 ) {
+            size_t discard_length = capacity_remaining < sizeof( discard_buffer ) ? capacity_remaining : sizeof( discard_buffer );
+            ssize_t num_read = recv( connection_fd, discard_buffer, discard_length, MSG_NOSIGNAL );
+            if ( num_read <= 0 ) {
+                break;
+            }
+            capacity_remaining -= (size_t) num_read;
+        }
+        _metrics_count_receive_failure( 0, true );
+        *message_length = 0;
+        return false;
+    }
+
+    _metrics_count_received( *message_length );
+    return true;
+}
+
+void nxai_socket_batch_init( nxai_socket_batch_t *batch, int connection_fd, size_t flush_size, uint64_t max_latency_us ) {
+    memset( batch, 0, sizeof( nxai_socket_batch_t ) );
+    batch->connection_fd = connection_fd;
+    batch->flush_size = flush_size;
+    batch->max_latency_us = max_latency_us;
+}
+
+bool nxai_socket_batch_append( nxai_socket_batch_t *batch, const char *record, uint32_t record_length ) {
+    if ( record_length > BATCH_MAX_RECORD_LENGTH ) {
+        printf( "Warning: Record of %u bytes does not fit in a batch message\n", record_length );
+        errno = EMSGSIZE;
+        return false;
+    }
+    size_t required_size = ( batch->used == 0 ? BATCH_HEADER_LENGTH : batch->used ) + MESSAGE_HEADER_LENGTH + record_length;
+    if ( required_size > UINT32_MAX ) {
+        // Would not fit in one message, send what we have first
+        if ( nxai_socket_batch_flush( batch ) == false ) {
+            return false;
+        }
+        required_size = BATCH_HEADER_LENGTH + MESSAGE_HEADER_LENGTH + record_length;
+    }
+    if ( required_size > batch->allocated_buffer_size ) {
+        size_t new_size = batch->allocated_buffer_size * 2 > required_size ? batch->allocated_buffer_size * 2 : required_size;
+        char *new_pointer = realloc( batch->buffer, new_size );
+        if ( new_pointer == NULL ) {
+            printf( "Error: Could not allocate batch buffer with length: %zu.\n", new_size );
+            return false;
+        }
+        batch->buffer = new_pointer;
+        batch->allocated_buffer_size = new_size;
+    }
+
+    if ( batch->used == 0 ) {
+        // Leave room for the batch header, which is filled in when flushing
+        batch->used = BATCH_HEADER_LENGTH;
+        batch->first_record_timestamp_us = nxai_monotonic_timestamp_us();
+    }
+    memcpy( batch->buffer + batch->used, &record_length, MESSAGE_HEADER_LENGTH );
+    memcpy( batch->buffer + batch->used + MESSAGE_HEADER_LENGTH, record, record_length );
+    batch->used += MESSAGE_HEADER_LENGTH + record_length;
+    batch->num_records++;
+
+    if ( batch->used >= batch->flush_size ) {
+        return nxai_socket_batch_flush( batch );
+    }
+    return nxai_socket_batch_flush_if_due( batch );
+}
+
+bool nxai_socket_batch_flush_if_due( nxai_socket_batch_t *batch ) {
+    if ( batch->num_records == 0 || nxai_monotonic_timestamp_us() - batch->first_record_timestamp_us < batch->max_latency_us ) {
+        return true;
+    }
+    return nxai_socket_batch_flush( batch );
+}
+
+bool nxai_socket_batch_flush( nxai_socket_batch_t *batch ) {
+    if ( batch->num_records == 0 ) {
+        return true;
+    }
+    uint32_t batch_magic = BATCH_MAGIC;
+    memcpy( batch->buffer, &batch_magic, sizeof( batch_magic ) );
+    memcpy( batch->buffer + sizeof( batch_magic ), &batch->num_records, sizeof( batch->num_records ) );
+    bool send_success = nxai_socket_send_to_connection( batch->connection_fd, batch->buffer, (uint32_t) batch->used );
+    // Records are dropped on failure, the connection is most likely unusable
+    batch->used = 0;
+    batch->num_records = 0;
+    return send_success;
+}
+
+void nxai_socket_batch_free( nxai_socket_batch_t *batch ) {
+    free( batch->buffer );
+    batch->buffer = NULL;
+    batch->allocated_buffer_size = 0;
+    batch->used = 0;
+    batch->num_records = 0;
+}
+
+bool nxai_socket_send_batch( const int connection_fd, const char *const *records, const uint32_t *record_lengths, size_t num_records ) {
+    // Each record takes two segments, its length and its data, after one segment for the batch header
+    const size_t max_records_per_message = ( NXAI_SOCKET_MAX_SEGMENTS - 1 ) / 2;
+    struct iovec segments[NXAI_SOCKET_MAX_SEGMENTS];
+    uint32_t batch_header[2] = { BATCH_MAGIC, 0 };
+
+    // Check all records first, the peer should get all of the batch or none of it
+    for ( size_t index = 0; index < num_records; index++ ) {
+        if ( record_lengths[index] > BATCH_MAX_RECORD_LENGTH ) {
+            printf( "Warning: Record of %u bytes does not fit in a batch message\n", record_lengths[index] );
+            errno = EMSGSIZE;
+            return false;
+        }
+    }
+
+    for ( size_t first_record = 0; first_record < num_records; first_record += max_records_per_message ) {
+        size_t num_message_records = num_records - first_record < max_records_per_message ? num_records - first_record : max_records_per_message;
+        batch_header[1] = (uint32_t) num_message_records;
+        segments[0].iov_base = batch_header;
+        segments[0].iov_len = BATCH_HEADER_LENGTH;
+        for ( size_t index = 0; index < num_message_records; index++ ) {
+            segments[1 + 2 * index].iov_base = (void *) &record_lengths[first_record + index];
+            segments[1 + 2 * index].iov_len = MESSAGE_HEADER_LENGTH;
+            segments[2 + 2 * index].iov_base = (void *) records[first_record + index];
+            segments[2 + 2 * index].iov_len = record_lengths[first_record + index];
+        }
+        if ( nxai_socket_sendv_to_connection( connection_fd, segments, 1 + 2 * num_message_records ) == false ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool nxai_socket_batch_next( const char *message, uint32_t message_length, size_t *offset, const char **record, uint32_t *record_length ) {
+    if ( *offset == 0 ) {
+        uint32_t batch_magic = 0;
+        if ( message_length >= BATCH_HEADER_LENGTH ) {
+            memcpy( &batch_magic, message, sizeof( batch_magic ) );
+        }
+        if ( batch_magic != BATCH_MAGIC ) {
+            printf( "Warning: Message of %u bytes is not a batch, ignoring it.\n", message_length );
+            return false;
+        }
+        *offset = BATCH_HEADER_LENGTH;
+    }
+    if ( *offset + MESSAGE_HEADER_LENGTH > message_length ) {
+        return false;
+    }
+    memcpy( record_length, message + *offset, MESSAGE_HEADER_LENGTH );
+    if ( *record_length > message_length - *offset - MESSAGE_HEADER_LENGTH ) {
+        printf( "Warning: Batch record of %u bytes exceeds the batch message, ignoring the rest of the batch.\n", *record_length );
+        return false;
+    }
+    *record = message + *offset + MESSAGE_HEADER_LENGTH;
+    *offset += MESSAGE_HEADER_LENGTH + *record_length;
+    return true;
+}
+
+// Request waiting for its response on an asynchronous client connection
+typedef struct {
+    uint64_t request_id;
+    nxai_socket_async_callback_t callback_function;
+    void *user_data;
+} _async_request_t;
+
+// Bytes of requests an asynchronous client connection holds while the socket is not writable, submitting
+// more fails with EAGAIN. A larger request is still taken when nothing else is waiting.
+#define ASYNC_SEND_QUEUE_LENGTH ( 4 * 1024 * 1024 )
+
+// Connection of an asynchronous client. Responses arrive in request order, so requests wait in a FIFO.
+typedef struct {
+    // Must be the first member, the response handler gets a pointer to it
+    _listener_connection_t receive_state;
+    pthread_mutex_t lock;
+    _async_request_t *requests;
+    size_t requests_capacity;
+    size_t requests_head;
+    size_t num_requests;
+    // Framed requests that could not be written yet, the client thread writes them when the socket is
+    // writable. The unsent bytes are those from send_offset up to send_length.
+    char *send_buffer;
+    size_t send_allocated;
+    size_t send_offset;
+    size_t send_length;
+    // Whether the client thread is woken when the socket is writable
+    bool watching_writable;
+} _async_connection_t;
+
+// Response that is waiting to be collected with nxai_socket_async_poll_completion
+typedef struct _async_completion {
+    uint64_t request_id;
+    char *response;
+    uint32_t response_length;
+    struct _async_completion *next;
+} _async_completion_t;
+
+struct nxai_socket_async_client {
+    char *socket_path;
+    _async_connection_t *connections;
+    size_t num_connections;
+    size_t next_connection;
+    uint64_t next_request_id;
+    int epoll_fd;
+    int stop_event_fd;
+    pthread_t thread;
+    _listener_t receive_handler;
+    // Completions of requests without callback, signalled through completion_event_fd
+    pthread_mutex_t completion_lock;
+    _async_completion_t *completions_head;
+    _async_completion_t *completions_tail;
+    int completion_event_fd;
+};
+
+/**
+ * @brief Delivers a response, or a failure when the response is NULL, for a request.
+ */
+static void _async_complete( nxai_socket_async_client_t *client, _async_request_t *request, const char *response, uint32_t response_length ) {
+    if ( request->callback_function != NULL ) {
+        request->callback_function( request->request_id, response, response_length, request->user_data );
+        return;
+    }
+
+    _async_completion_t *completion = calloc( 1, sizeof( _async_completion_t ) );
+    if ( completion == NULL ) {
+        printf( "Error: Could not allocate completion for request %llu.\n", (unsigned long long) request->request_id );
+        return;
+    }
+    completion->request_id = request->request_id;
+    if ( response != NULL ) {
+        completion->response = malloc( response_length > 0 ? response_length : 1 );
+        if ( completion->response == NULL ) {
+            printf( "Error: Could not allocate buffer with length: %u. Dropping response.\n", response_length );
+        } else {
+            memcpy( completion->response, response, response_length );
+            completion->response_length = response_length;
+        }
+    }
+
+    pthread_mutex_lock( &client->completion_lock );
+    if ( client->completions_tail == NULL ) {
+        client->completions_head = completion;
+    } else {
+        client->completions_tail->next = completion;
+    }
+    client->completions_tail = completion;
+    uint64_t increment = 1;
+    if ( write( client->completion_event_fd, &increment, sizeof( increment ) ) == -1 ) {
+        printf( "Warning: Could not signal request completion: %s\n", strerror( errno ) );
+    }
+    pthread_mutex_unlock( &client->completion_lock );
+}
+
+static void _async_handle_response( void *handler_context, _listener_connection_t *receive_state, const char *message, uint32_t message_length ) {
+    nxai_socket_async_client_t *client = handler_context;
+    _async_connection_t *connection = (_async_connection_t *) receive_state;
+
+    pthread_mutex_lock( &connection->lock );
+    if ( connection->num_requests == 0 ) {
+        pthread_mutex_unlock( &connection->lock );
+        printf( "Warning: Received response without request, ignoring message.\n" );
+        return;
+    }
+    _async_request_t request = connection->requests[connection->requests_head];
+    connection->requests_head = ( connection->requests_head + 1 ) % connection->requests_capacity;
+    connection->num_requests--;
+    pthread_mutex_unlock( &connection->lock );
+
+    _async_complete( client, &request, message, message_length );
+}
+
+/**
+ * @brief Writes queued requests until the socket is full, without blocking. Called with the connection locked.
+ *
+ * The client thread is woken when the socket is writable for as long as requests are queued.
+ *
+ * @return false if the connection failed.
+ */
+static bool _async_connection_flush( nxai_socket_async_client_t *client, _async_connection_t *connection ) {
+    while ( connection->send_offset < connection->send_length ) {
+        ssize_t num_sent = send( connection->receive_state.connection_fd, connection->send_buffer + connection->send_offset,
+                                 connection->send_length - connection->send_offset, MSG_NOSIGNAL | MSG_DONTWAIT );
+        if ( num_sent == -1 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+                break;
+            }
+            _metrics_count_send_failure();
+            printf( "Warning: send to socket failed: %s\n", strerror( errno ) );
+            return false;
+        }
+        connection->send_offset += (size_t) num_sent;
+    }
+    bool queued = connection->send_offset < connection->send_length;
+    if ( queued == false ) {
+        connection->send_offset = 0;
+        connection->send_length = 0;
+    }
+    if ( queued != connection->watching_writable ) {
+        struct epoll_event connection_event = { .events = EPOLLIN | EPOLLRDHUP | ( queued ? EPOLLOUT : 0 ), .data.ptr = connection };
+        epoll_ctl( client->epoll_fd, EPOLL_CTL_MOD, connection->receive_state.connection_fd, &connection_event );
+        connection->watching_writable = queued;
+    }
+    return true;
+}
+
+/**
+ * @brief Closes a connection and fails all requests waiting on it. Called from the client thread.
+ */
+static void _async_connection_fail( nxai_socket_async_client_t *client, _async_connection_t *connection ) {
+    pthread_mutex_lock( &connection->lock );
+    if ( connection->receive_state.connection_fd != -1 ) {
+        epoll_ctl( client->epoll_fd, EPOLL_CTL_DEL, connection->receive_state.connection_fd, NULL );
+        close( connection->receive_state.connection_fd );
+        connection->receive_state.connection_fd = -1;
+    }
+    // Reset reassembly state for the next connection
+    if ( connection->receive_state.header_received > 0 ) {
+        _metrics_add( &_metrics.partial_reads, 1 );
+    }
+    connection->receive_state.header_received = 0;
+    _close_fds( connection->receive_state.pending_fds, connection->receive_state.num_pending_fds );
+    connection->receive_state.num_pending_fds = 0;
+    size_t num_failed = connection->num_requests;
+    _async_request_t *failed = malloc( ( num_failed > 0 ? num_failed : 1 ) * sizeof( _async_request_t ) );
+    for ( size_t index = 0; failed != NULL && index < num_failed; index++ ) {
+        failed[index] = connection->requests[( connection->requests_head + index ) % connection->requests_capacity];
+    }
+    connection->num_requests = 0;
+    connection->requests_head = 0;
+    // Requests that were not written yet failed as well
+    connection->send_offset = 0;
+    connection->send_length = 0;
+    connection->watching_writable = false;
+    pthread_mutex_unlock( &connection->lock );
+
+    // Complete outside the lock, callbacks may submit new requests
+    for ( size_t index = 0; failed != NULL && index < num_failed; index++ ) {
+        _async_complete( client, &failed[index], NULL, 0 );
+    }
+    free( failed );
+}
+
+static void *_async_client_run( void *argument ) {
+    nxai_socket_async_client_t *client = argument;
+    char *staging_buffer = malloc( LISTENER_STAGING_BUFFER_SIZE );
+    if ( staging_buffer == NULL ) {
+        printf( "Error: Could not allocate asynchronous client receive buffer.\n" );
+        return NULL;
+    }
+    struct epoll_event events[LISTENER_MAX_EVENTS];
+
+    while ( true ) {
+        int num_events = epoll_wait( client->epoll_fd, events, LISTENER_MAX_EVENTS, -1 );
+        if ( num_events == -1 && errno != EINTR ) {
+            printf( "Error: Asynchronous client event loop failed: %s\n", strerror( errno ) );
+            break;
+        }
+        bool stopping = false;
+        for ( int index = 0; index < num_events; index++ ) {
+            if ( events[index].data.ptr == NULL ) {
+                stopping = true;
+                continue;
+            }
+            _async_connection_t *connection = events[index].data.ptr;
+            if ( events[index].events & EPOLLOUT ) {
+                pthread_mutex_lock( &connection->lock );
+                bool flushed = connection->receive_state.connection_fd == -1 || _async_connection_flush( client, connection );
+                pthread_mutex_unlock( &connection->lock );
+                if ( flushed == false ) {
+                    _async_connection_fail( client, connection );
+                    continue;
+                }
+            }
+            if ( ( events[index].events & ~EPOLLOUT ) == 0 ) {
+                continue;
+            }
+            if ( _listener_connection_read( &client->receive_handler, &connection->receive_state, staging_buffer ) == false ) {
+                _async_connection_fail( client, connection );
+            }
+        }
+        if ( stopping == true ) {
+            break;
+        }
+    }
+
+    free( staging_buffer );
+    return NULL;
+}
+
+nxai_socket_async_client_t *nxai_socket_async_client_create( const char *socket_path, size_t num_connections ) {
+    if ( num_connections == 0 ) {
+        printf( "Error: Asynchronous client needs at least one connection.\n" );
+        return NULL;
+    }
+    nxai_socket_async_client_t *client = calloc( 1, sizeof( nxai_socket_async_client_t ) );
+    if ( client == NULL ) {
+        return NULL;
+    }
+    client->socket_path = strdup( socket_path );
+    client->connections = calloc( num_connections, sizeof( _async_connection_t ) );
+    client->num_connections = num_connections;
+    client->next_request_id = 1;
+    client->epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    client->stop_event_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    client->completion_event_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    client->receive_handler.message_handler = _async_handle_response;
+    client->receive_handler.handler_context = client;
+    pthread_mutex_init( &client->completion_lock, NULL );
+    for ( size_t index = 0; client->connections != NULL && index < num_connections; index++ ) {
+        client->connections[index].receive_state.connection_fd = -1;
+        pthread_mutex_init( &client->connections[index].lock, NULL );
+    }
+
+    struct epoll_event stop_event = { .events = EPOLLIN, .data.ptr = NULL };
+    if ( client->socket_path == NULL || client->connections == NULL || client->epoll_fd == -1 || client->stop_event_fd == -1 || client->completion_event_fd == -1
+         || epoll_ctl( client->epoll_fd, EPOLL_CTL_ADD, client->stop_event_fd, &stop_event ) == -1
+         || pthread_create( &client->thread, NULL, _async_client_run, client ) != 0 ) {
+        printf( "Error: Failed to set up asynchronous client for %s.\n", socket_path );
+        if ( client->epoll_fd != -1 ) {
+            close( client->epoll_fd );
+        }
+        if ( client->stop_event_fd != -1 ) {
+            close( client->stop_event_fd );
+        }
+        if ( client->completion_event_fd != -1 ) {
+            close( client->completion_event_fd );
+        }
+        for ( size_t index = 0; client->connections != NULL && index < num_connections; index++ ) {
+            pthread_mutex_destroy( &client->connections[index].lock );
+        }
+        pthread_mutex_destroy( &client->completion_lock );
+        free( client->connections );
+        free( client->socket_path );
+        free( client );
+        return NULL;
+    }
+
+    return client;
+}
+
+uint64_t nxai_socket_async_submit( nxai_socket_async_client_t *client, const char *message_to_send, uint32_t message_length, nxai_socket_async_callback_t callback_function, void *user_data ) {
+    // Spread requests over the connections
+    size_t connection_index = __atomic_fetch_add( &client->next_connection, 1, __ATOMIC_RELAXED ) % client->num_connections;
+    _async_connection_t *connection = &client->connections[connection_index];
+
+    pthread_mutex_lock( &connection->lock );
+
+    // (Re)connect lazily, without holding the lock while connecting
+    if ( connection->receive_state.connection_fd == -1 ) {
+        pthread_mutex_unlock( &connection->lock );
+        int connection_fd = nxai_socket_connect( client->socket_path );
+        if ( connection_fd == -1 ) {
+            return 0;
+        }
+        fcntl( connection_fd, F_SETFL, fcntl( connection_fd, F_GETFL ) | O_NONBLOCK );
+        pthread_mutex_lock( &connection->lock );
+        if ( connection->receive_state.connection_fd == -1 ) {
+            connection->receive_state.connection_fd = connection_fd;
+            struct epoll_event connection_event = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = connection };
+            epoll_ctl( client->epoll_fd, EPOLL_CTL_ADD, connection_fd, &connection_event );
+        } else {
+            // Another submit connected first
+            close( connection_fd );
+        }
+    }
+
+    // Never wait for the socket, the client thread writes what does not fit now
+    size_t queued = connection->send_length - connection->send_offset;
+    size_t framed_length = MESSAGE_HEADER_LENGTH + (size_t) message_length;
+    if ( queued > 0 && queued + framed_length > ASYNC_SEND_QUEUE_LENGTH ) {
+        pthread_mutex_unlock( &connection->lock );
+        errno = EAGAIN;
+        return 0;
+    }
+    if ( connection->send_offset > 0 ) {
+        memmove( connection->send_buffer, connection->send_buffer + connection->send_offset, queued );
+        connection->send_offset = 0;
+        connection->send_length = queued;
+    }
+    if ( queued + framed_length > connection->send_allocated ) {
+        char *new_pointer = realloc( connection->send_buffer, queued + framed_length );
+        if ( new_pointer == NULL ) {
+            pthread_mutex_unlock( &connection->lock );
+            printf( "Error: Could not allocate buffer with length: %zu.\n", queued + framed_length );
+            errno = ENOMEM;
+            return 0;
+        }
+        connection->send_buffer = new_pointer;
+        connection->send_allocated = queued + framed_length;
+    }
+
+    // Register the request before sending, the response may arrive before send returns
+    if ( connection->num_requests == connection->requests_capacity ) {
+        size_t new_capacity = connection->requests_capacity == 0 ? 16 : 2 * connection->requests_capacity;
+        _async_request_t *new_requests = malloc( new_capacity * sizeof( _async_request_t ) );
+        if ( new_requests == NULL ) {
+            pthread_mutex_unlock( &connection->lock );
+            printf( "Error: Could not allocate request queue.\n" );
+            errno = ENOMEM;
+            return 0;
+        }
+        for ( size_t index = 0; index < connection->num_requests; index++ ) {
+            new_requests[index] = connection->requests[( connection->requests_head + index ) % connection->requests_capacity];
+        }
+        free( connection->requests );
+        connection->requests = new_requests;
+        connection->requests_capacity = new_capacity;
+        connection->requests_head = 0;
+    }
+    _async_request_t *request = &connection->requests[( connection->requests_head + connection->num_requests ) % connection->requests_capacity];
+    request->request_id = __atomic_fetch_add( &client->next_request_id, 1, __ATOMIC_RELAXED );
+    request->callback_function = callback_function;
+    request->user_data = user_data;
+    connection->num_requests++;
+    uint64_t request_id = request->request_id;
+
+    memcpy( connection->send_buffer + connection->send_length, &message_length, MESSAGE_HEADER_LENGTH );
+    memcpy( connection->send_buffer + connection->send_length + MESSAGE_HEADER_LENGTH, message_to_send, message_length );
+    connection->send_length += framed_length;
+    if ( queued == 0 && _async_connection_flush( client, connection ) == false ) {
+        // Part of the frame may have gone out, so the stream can not be used anymore. Withdraw this request,
+        // shut the connection down and let the client thread fail the others.
+        connection->num_requests--;
+        connection->send_offset = 0;
+        connection->send_length = 0;
+        shutdown( connection->receive_state.connection_fd, SHUT_RDWR );
+        pthread_mutex_unlock( &connection->lock );
+        return 0;
+    }
+
+    pthread_mutex_unlock( &connection->lock );
+    _metrics_count_sent( message_length );
+    return request_id;
+}
+
+int nxai_socket_async_client_get_fd( nxai_socket_async_client_t *client ) {
+    return client->completion_event_fd;
+}
+
+bool nxai_socket_async_poll_completion( nxai_socket_async_client_t *client, uint64_t *request_id, char **response_buffer, size_t *allocated_buffer_size, uint32_t *response_length ) {
+    pthread_mutex_lock( &client->completion_lock );
+    _async_completion_t *completion = client->completions_head;
+    if ( completion != NULL ) {
+        client->completions_head = completion->next;
+        if ( client->completions_head == NULL ) {
+            client->completions_tail = NULL;
+        }
+    }
+    if ( client->completions_head == NULL ) {
+        // Nothing left, stop signalling the completion event
+        uint64_t count;
+        if ( read( client->completion_event_fd, &count, sizeof( count ) ) == -1 && errno != EAGAIN ) {
+            printf( "Warning: Could not reset request completion event.\n" );
+        }
+    }
+    pthread_mutex_unlock( &client->completion_lock );
+
+    if ( completion == NULL ) {
+        return false;
+    }
+
+    *request_id = completion->request_id;
+    *response_length = completion->response_length;
+    if ( completion->response != NULL ) {
+        // Hand over the response buffer when the caller has none, otherwise copy into it
+        if ( *response_buffer == NULL ) {
+            *response_buffer = completion->response;
+            *allocated_buffer_size = completion->response_length;
+            completion->response = NULL;
+        } else if ( completion->response_length > *allocated_buffer_size ) {
+            free( *response_buffer );
+            *response_buffer = completion->response;
+            *allocated_buffer_size = completion->response_length;
+            completion->response = NULL;
+        } else {
+            memcpy( *response_buffer, completion->response, completion->response_length );
+        }
+    }
+    free( completion->response );
+    free( completion );
+    return true;
+}
+
+void nxai_socket_async_client_destroy( nxai_socket_async_client_t *client ) {
+    uint64_t increment = 1;
+    if ( write( client->stop_event_fd, &increment, sizeof( increment ) ) == -1 ) {
+        printf( "Warning: Could not stop asynchronous client thread.\n" );
+    }
+    pthread_join( client->thread, NULL );
+
+    // Fail requests that are still waiting, then drop undelivered completions
+    for ( size_t index = 0; index < client->num_connections; index++ ) {
+        _async_connection_fail( client, &client->connections[index] );
+        free( client->connections[index].receive_state.message_buffer );
+        free( client->connections[index].requests );
+        free( client->connections[index].send_buffer );
+        pthread_mutex_destroy( &client->connections[index].lock );
+    }
+    while ( client->completions_head != NULL ) {
+        _async_completion_t *completion = client->completions_head;
+        client->completions_head = completion->next;
+        free( completion->response );
+        free( completion );
+    }
+
+    close( client->epoll_fd );
+    close( client->stop_event_fd );
+    close( client->completion_event_fd );
+    pthread_mutex_destroy( &client->completion_lock );
+    free( client->connections );
+    free( client->socket_path );
+    free( client );
+}